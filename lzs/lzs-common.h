@@ -31,6 +31,14 @@
 #ifndef __LZS_COMMON_H
 #define __LZS_COMMON_H
 
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
 /*****************************************************************************
  * Implementation Defines
  ****************************************************************************/
@@ -54,11 +62,121 @@
 
 #define LZSMIN(X,Y)                 (((X) < (Y)) ? (X) : (Y))
 
+/*
+ * lzs_match_len() variant, selected at compile time:
+ *     * LZS_MATCH_SSE2 compares 16 bytes at a time, on x86 with SSE2
+ *     * LZS_MATCH_NEON compares 16 bytes at a time, on little-endian ARM with NEON
+ *     * LZS_MATCH_WORD compares 8 bytes at a time, on any little-endian target
+ * All of them need count-trailing-zeros of GCC, Clang or MSVC. Remaining bytes
+ * are compared one at a time.
+ */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LZS_MATCH_WORD
+#define lzs_ctz32(X)                ((uint_fast8_t)__builtin_ctz(X))
+#define lzs_ctz64(X)                ((uint_fast8_t)__builtin_ctzll(X))
+#if defined(__SSE2__)
+#define LZS_MATCH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define LZS_MATCH_NEON
+#include <arm_neon.h>
+#endif
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#define LZS_MATCH_WORD
+#include <intrin.h>
+#if defined(_M_X64)
+#define LZS_MATCH_SSE2
+#include <emmintrin.h>
+#else
+#define LZS_MATCH_NEON
+#include <arm_neon.h>
+#endif
+static inline uint_fast8_t lzs_ctz32(uint32_t x)
+{
+    unsigned long   index;
+
+
+    _BitScanForward(&index, x);
+    return (uint_fast8_t)index;
+}
+
+static inline uint_fast8_t lzs_ctz64(uint64_t x)
+{
+    unsigned long   index;
+
+
+    _BitScanForward64(&index, x);
+    return (uint_fast8_t)index;
+}
+#endif
+
 
 /*****************************************************************************
  * Inline Functions
  ****************************************************************************/
 
+// Return count of equal leading bytes of aPtr and bPtr, up to matchMax.
+// No bytes are read past matchMax.
+static inline size_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    size_t          len;
+#if defined(LZS_MATCH_WORD)
+    uint64_t        aWord;
+    uint64_t        bWord;
+#endif
+#if defined(LZS_MATCH_SSE2)
+    uint32_t        mask;
+#elif defined(LZS_MATCH_NEON)
+    uint64_t        mask;
+#endif
+
+
+    len = 0;
+#if defined(LZS_MATCH_SSE2)
+    // First differing byte is the lowest clear bit of byte equality mask.
+    for ( ; len + 16u <= matchMax; len += 16u)
+    {
+        mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(aPtr + len)),
+                                                         _mm_loadu_si128((const __m128i *)(bPtr + len))));
+        if (mask != 0xFFFFu)
+        {
+            return len + lzs_ctz32(~mask);
+        }
+    }
+#elif defined(LZS_MATCH_NEON)
+    // Byte equality mask is narrowed to 4 bits per byte.
+    for ( ; len + 16u <= matchMax; len += 16u)
+    {
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+                    vceqq_u8(vld1q_u8(aPtr + len), vld1q_u8(bPtr + len))), 4)), 0);
+        if (mask != UINT64_MAX)
+        {
+            return len + (lzs_ctz64(~mask) >> 2u);
+        }
+    }
+#endif
+#if defined(LZS_MATCH_WORD)
+    // First differing byte is the lowest set byte of XOR.
+    for ( ; len + sizeof(aWord) <= matchMax; len += sizeof(aWord))
+    {
+        memcpy(&aWord, aPtr + len, sizeof(aWord));
+        memcpy(&bWord, bPtr + len, sizeof(bWord));
+        if (aWord != bWord)
+        {
+            return len + (lzs_ctz64(aWord ^ bWord) >> 3u);
+        }
+    }
+#endif
+    for ( ; len < matchMax; len++)
+    {
+        if (aPtr[len] != bPtr[len])
+        {
+            return len;
+        }
+    }
+    return len;
+}
+
 static inline uint_fast16_t lzs_idx_inc_wrap(uint_fast16_t idx, uint_fast16_t inc, uint_fast16_t array_size)
 {
     uint_fast16_t new_idx;
@@ -126,21 +126,6 @@ static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
  * Inline Functions
  ****************************************************************************/
 
-static inline uint_fast8_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t matchMax)
-{
-    uint_fast8_t    len;
-
-
-    for (len = 0; len < matchMax; len++)
-    {
-        if (*aPtr++ != *bPtr++)
-        {
-            return len;
-        }
-    }
-    return len;
-}
-
 static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pParams, uint_fast16_t offset, uint_fast8_t matchMax)
 {
     uint_fast16_t   historyReadIdx;
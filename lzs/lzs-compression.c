@@ -60,6 +60,18 @@
  ****************************************************************************/
 
 #define LZS_SEARCH_MATCH_MAX        12u
+#define LZS_NICE_MATCH_MAX          255u
+
+// Input bytes priced at once by the optimal parse.
+#define LZS_OPTIMAL_WINDOW          4096u
+
+#define LITERAL_BITS                9u
+
+// Fast level hashes 3 input bytes into a table of the latest input positions.
+#define FAST_HASH_BITS              14u
+#define FAST_HASH_SIZE              (1u << FAST_HASH_BITS)
+// Fast level emits 1 more literal per probe after each 32 failed probes in a row.
+#define FAST_SKIP_SHIFT             5u
 
 //#define LZS_DEBUG(X)                printf X
 #define LZS_DEBUG(X)
@@ -83,6 +95,39 @@ typedef enum
     COMPRESS_EXTENDED
 } SimpleCompressState_t;
 
+typedef enum
+{
+    PARSE_GREEDY,
+    PARSE_LAZY,
+    PARSE_OPTIMAL,
+    PARSE_FAST
+} LzsParse_t;
+
+typedef struct
+{
+    uint16_t            maxChain;           // Hash chain candidates tried at each input position
+    uint16_t            niceLength;         // Search stops at a match of this length
+    uint16_t            lazyLength;         // Lazy parse looks ahead only after a shorter match
+    uint8_t             parse;              // LzsParse_t
+} LzsLevelConfig_t;
+
+typedef struct
+{
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+    size_t              historyLen;
+    uint_fast16_t       historyLatestIdx;
+} LzsMatchFinder_t;
+
+typedef struct
+{
+    uint8_t           * outPtr;
+    size_t              outCount;           // Count of output bytes that have been generated
+    size_t              outBufferSize;
+    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
+    uint_fast8_t        bitFieldQueueLen;
+} LzsBitWriter_t;
+
 
 /*****************************************************************************
  * Tables
@@ -123,6 +168,26 @@ static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
     4,
 };
 
+/* Level 1 is the original greedy parse. Lazy levels look one byte ahead for
+ * a match that saves more bits, when the current match is shorter than the
+ * lazy length; optimal levels choose the cheapest sequence of tokens by bit
+ * price over each LZS_OPTIMAL_WINDOW of input, searching deeper hash chains at
+ * higher levels. The fast level keeps no hash chains, so it has a single
+ * candidate per position. */
+static const LzsLevelConfig_t level_config[LZS_LEVEL_MAX - LZS_LEVEL_MIN + 1u] =
+{
+    { 1u,                   LZS_NICE_MATCH_MAX,     0u,                 PARSE_FAST },       // 0
+    { LZS_MAX_HISTORY_SIZE, LZS_SEARCH_MATCH_MAX,   0u,                 PARSE_GREEDY },     // 1
+    { LZS_MAX_HISTORY_SIZE, 32u,                    0u,                 PARSE_GREEDY },     // 2
+    { LZS_MAX_HISTORY_SIZE, 32u,                    8u,                 PARSE_LAZY },       // 3
+    { LZS_MAX_HISTORY_SIZE, LZS_NICE_MATCH_MAX,     LZS_NICE_MATCH_MAX, PARSE_LAZY },       // 4
+    { 32u,                  32u,                    0u,                 PARSE_OPTIMAL },    // 5
+    { 64u,                  32u,                    0u,                 PARSE_OPTIMAL },    // 6
+    { 128u,                 64u,                    0u,                 PARSE_OPTIMAL },    // 7
+    { 512u,                 128u,                   0u,                 PARSE_OPTIMAL },    // 8
+    { LZS_MAX_HISTORY_SIZE, LZS_NICE_MATCH_MAX,     0u,                 PARSE_OPTIMAL },    // 9
+};
+
 
 /*****************************************************************************
  * Inline Functions
@@ -149,21 +214,6 @@ static inline lzs_input_hash_t inputs_hash_inc(const LzsCompressParameters_t * p
     return inputs_hash(pParams->historyBuffer[index0], pParams->historyBuffer[index1]);
 }
 
-static inline uint_fast8_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t matchMax)
-{
-    uint_fast8_t    len;
-
-
-    for (len = 0; len < matchMax; len++)
-    {
-        if (*aPtr++ != *bPtr++)
-        {
-            return len;
-        }
-    }
-    return len;
-}
-
 static inline uint_fast8_t lzs_inc_match_len(LzsCompressParameters_t * pParams, uint_fast16_t offset, uint_fast8_t matchMax)
 {
     uint_fast16_t   historyReadIdx;
@@ -191,233 +241,538 @@ static inline uint_fast8_t lzs_inc_match_len(LzsCompressParameters_t * pParams,
 
 
 /*****************************************************************************
- * Functions
+ * Single-call compression helpers
  ****************************************************************************/
 
+static void lzs_match_finder_init(LzsMatchFinder_t * pFinder)
+{
+    // historyHash[] is not initialised, its entries are written before
+    // hashTable[] can refer to them.
+    memset(pFinder->hashTable, 0xFF, sizeof(pFinder->hashTable));
+    pFinder->historyLen = 0;
+    pFinder->historyLatestIdx = 0;
+}
+
+// Add input byte at inPtr to history.
+static inline void lzs_match_finder_insert(LzsMatchFinder_t * pFinder, const uint8_t * inPtr, size_t inRemaining)
+{
+    lzs_input_hash_t    inputHash;
+
+
+    if (inRemaining >= MIN_LENGTH)
+    {
+        inputHash = inputs_hash(*inPtr, *(inPtr + 1));
+        pFinder->historyHash[pFinder->historyLatestIdx] = pFinder->hashTable[inputHash];
+        pFinder->hashTable[inputHash] = pFinder->historyLatestIdx;
+    }
+    else
+    {
+        // The last input byte can't start a match, so it is not hashed.
+        pFinder->historyHash[pFinder->historyLatestIdx] = (uint16_t)-1;
+    }
+    pFinder->historyLatestIdx = lzs_idx_inc_wrap(pFinder->historyLatestIdx, 1u, ARRAY_ENTRIES(pFinder->historyHash));
+    pFinder->historyLen = LZSMIN(pFinder->historyLen + 1u, LZS_MAX_HISTORY_SIZE);
+}
+
+static void lzs_match_finder_skip(LzsMatchFinder_t * pFinder, const uint8_t * inPtr, size_t inRemaining, size_t count)
+{
+    for ( ; count > 0; count--)
+    {
+        lzs_match_finder_insert(pFinder, inPtr++, inRemaining--);
+    }
+}
+
 /*
- * Single-call compression
+ * Find the longest match in history for the input at inPtr.
  *
- * No state is kept between calls. Compression is expected to complete in a single call.
- * It will stop if/when it reaches the end of either the input or the output buffer.
+ * Candidates are tried nearest first, so the nearest of equally long matches is
+ * returned. A match that reaches the level's nice length is extended as far as
+ * the input allows. If pShortLength is given, the longest match within short
+ * offset range is returned in it, along with its offset in pShortOffset.
  */
-size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+static size_t lzs_find_match(const LzsMatchFinder_t * pFinder, const LzsLevelConfig_t * pConfig,
+                             const uint8_t * inPtr, size_t inRemaining, uint_fast16_t * pOffset,
+                             size_t * pShortLength, uint_fast16_t * pShortOffset)
 {
-    const uint8_t     * inPtr;
-    uint8_t           * outPtr;
-    uint16_t            hashTable[INPUT_HASH_SIZE];
-    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
-    size_t              historyLen;
-    size_t              inRemaining;        // Count of remaining bytes of input
-    size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
-    lzs_input_hash_t    inputHash;
-    uint_fast8_t        bitFieldQueueLen;
     uint_fast16_t       historyReadIdx;
-    uint_fast16_t       historyLatestIdx;
     uint_fast16_t       offset;
-    uint_fast8_t        matchMax;
-    uint_fast8_t        length;
-    uint_fast16_t       best_offset;
-    uint_fast8_t        best_length;
+    uint_fast16_t       chain;
     uint16_t            temp16;
-    uint8_t             temp8;
-    SimpleCompressState_t state;
+    size_t              matchMax;
+    size_t              length;
+    size_t              best_length;
+    size_t              short_length;
 
 
-#if 0
-    // TODO: Do initialisation of hash tables for consistency.
-    for (temp16 = 0; temp16 < ARRAY_ENTRIES(hashTable); temp16++)
+    best_length = 0;
+    short_length = 0;
+    matchMax = LZSMIN(inRemaining, pConfig->niceLength);
+    if (matchMax >= MIN_LENGTH)
     {
-        hashTable[temp16] = (uint16_t)-1;
+        historyReadIdx = pFinder->hashTable[inputs_hash(*inPtr, *(inPtr + 1))];
+        if (historyReadIdx < pFinder->historyLen)
+        {
+            offset = lzs_idx_delta2_wrap(pFinder->historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(pFinder->historyHash));
+
+            for (chain = pConfig->maxChain; offset <= pFinder->historyLen && chain > 0; chain--)
+            {
+                length = lzs_match_len(inPtr, inPtr - offset, matchMax);
+                if (length > best_length)
+                {
+                    *pOffset = offset;
+                    best_length = length;
+                    // Offsets grow along the chain, so short offsets come first.
+                    if (offset <= SHORT_OFFSET_MAX)
+                    {
+                        short_length = length;
+                        if (pShortOffset)
+                        {
+                            *pShortOffset = offset;
+                        }
+                    }
+                    if (length >= matchMax)
+                    {
+                        break;
+                    }
+                }
+
+                // Get next offset from historyHash[]
+                historyReadIdx = pFinder->historyHash[historyReadIdx];
+                if (historyReadIdx >= pFinder->historyLen)
+                {
+                    break;
+                }
+                // Calculate new offset.
+                temp16 = lzs_idx_delta2_wrap(pFinder->historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(pFinder->historyHash));
+                if (temp16 <= offset)
+                {
+                    break;
+                }
+                offset = temp16;
+            }
+        }
+        if (best_length == matchMax && matchMax < inRemaining)
+        {
+            best_length += lzs_match_len(inPtr + matchMax, inPtr + matchMax - *pOffset, inRemaining - matchMax);
+            if (short_length == matchMax)
+            {
+                short_length = best_length;
+            }
+        }
+    }
+    if (pShortLength)
+    {
+        *pShortLength = short_length;
     }
+    return best_length;
+}
+
+// Size in bits of an offset/length token.
+static inline uint32_t lzs_match_price(uint_fast16_t offset, size_t length)
+{
+    uint32_t            price;
+
 
-    historyLen = ARRAY_ENTRIES(historyHash);
-    if (historyLen > a_inLen)
+    price = 2u + ((offset <= SHORT_OFFSET_MAX) ? SHORT_OFFSET_BITS : LONG_OFFSET_BITS);
+    if (length < MAX_SHORT_LENGTH)
     {
-        historyLen = a_inLen;
+        return price + length_width[length];
     }
-    for (temp16 = 0; temp16 < historyLen; temp16++)
+    return price + LENGTH_MAX_BIT_WIDTH + EXTENDED_LENGTH_BITS * ((length - MAX_SHORT_LENGTH) / MAX_EXTENDED_LENGTH + 1u);
+}
+
+// Bits saved by an offset/length token, compared to byte-literals.
+static inline size_t lzs_match_gain(uint_fast16_t offset, size_t length)
+{
+    return LITERAL_BITS * length - lzs_match_price(offset, length);
+}
+
+static inline void lzs_put_bits(LzsBitWriter_t * pWriter, uint_fast16_t value, uint_fast8_t width)
+{
+    pWriter->bitFieldQueue <<= width;
+    pWriter->bitFieldQueue |= value;
+    pWriter->bitFieldQueueLen += width;
+    /* Copy output bits to output buffer, dropping what doesn't fit */
+    while (pWriter->bitFieldQueueLen >= 8u)
     {
-        historyHash[temp16] = (uint16_t)-1;
+        if (pWriter->outCount < pWriter->outBufferSize)
+        {
+            *pWriter->outPtr++ = (pWriter->bitFieldQueue >> (pWriter->bitFieldQueueLen - 8u));
+            pWriter->outCount++;
+        }
+        pWriter->bitFieldQueueLen -= 8u;
     }
-#endif
+}
 
-    historyLen = 0;
-    bitFieldQueue = 0;
-    bitFieldQueueLen = 0;
-    historyLatestIdx = 0;
-    inPtr = a_pInData;
-    outPtr = a_pOutData;
-    inRemaining = a_inLen;
-    outCount = 0;
-    state = COMPRESS_NORMAL;
+static inline bool lzs_writer_full(const LzsBitWriter_t * pWriter)
+{
+    return pWriter->outCount >= pWriter->outBufferSize;
+}
 
-    for (;;)
+static inline void lzs_put_literal(LzsBitWriter_t * pWriter, uint8_t value)
+{
+    /* Leading 0 bit indicates byte-literal.
+     * Following 8 bits are byte-literal. */
+    LZS_DEBUG(("Literal %c (%02X)\n", isprint(value) ? value : '?', value));
+    lzs_put_bits(pWriter, value, LITERAL_BITS);
+}
+
+static void lzs_put_match(LzsBitWriter_t * pWriter, uint_fast16_t offset, size_t length)
+{
+    uint_fast8_t        short_length;
+
+
+    LZS_DEBUG(("Offset %"PRIuFAST16" length %zu\n", offset, length));
+    /* Leading 1 bit indicates offset/length token */
+    if (offset <= SHORT_OFFSET_MAX)
     {
-        /* Copy output bits to output buffer */
-        while (bitFieldQueueLen >= 8u)
+        /* Then 1 bit indicates short offset */
+        lzs_put_bits(pWriter, (3u << SHORT_OFFSET_BITS) | offset, 2u + SHORT_OFFSET_BITS);
+    }
+    else
+    {
+        /* Then 0 bit indicates long offset */
+        lzs_put_bits(pWriter, (2u << LONG_OFFSET_BITS) | offset, 2u + LONG_OFFSET_BITS);
+    }
+    /* Encode length */
+    short_length = LZSMIN(length, MAX_SHORT_LENGTH);
+    lzs_put_bits(pWriter, length_value[short_length], length_width[short_length]);
+    if (short_length == MAX_SHORT_LENGTH)
+    {
+        /* Extended length is a run of 4-bit fields, ending with one below the maximum */
+        for (length -= MAX_SHORT_LENGTH; length >= MAX_EXTENDED_LENGTH; length -= MAX_EXTENDED_LENGTH)
+        {
+            lzs_put_bits(pWriter, MAX_EXTENDED_LENGTH, EXTENDED_LENGTH_BITS);
+        }
+        lzs_put_bits(pWriter, length, EXTENDED_LENGTH_BITS);
+    }
+}
+
+// Take the longest match at each input position.
+static void lzs_parse_greedy(LzsMatchFinder_t * pFinder, LzsBitWriter_t * pWriter, const LzsLevelConfig_t * pConfig,
+                             const uint8_t * inPtr, size_t inRemaining)
+{
+    uint_fast16_t       offset;
+    size_t              length;
+
+
+    while (inRemaining > 0 && !lzs_writer_full(pWriter))
+    {
+        length = lzs_find_match(pFinder, pConfig, inPtr, inRemaining, &offset, NULL, NULL);
+        if (length < MIN_LENGTH)
         {
-            if (outCount >= a_outBufferSize)
+            lzs_put_literal(pWriter, *inPtr);
+            length = 1u;
+        }
+        else
+        {
+            lzs_put_match(pWriter, offset, length);
+        }
+        lzs_match_finder_skip(pFinder, inPtr, inRemaining, length);
+        inPtr += length;
+        inRemaining -= length;
+    }
+}
+
+// Defer a match by a byte-literal when the match at the next input position saves more bits.
+static void lzs_parse_lazy(LzsMatchFinder_t * pFinder, LzsBitWriter_t * pWriter, const LzsLevelConfig_t * pConfig,
+                           const uint8_t * inPtr, size_t inRemaining)
+{
+    uint_fast16_t       offset;
+    uint_fast16_t       next_offset;
+    size_t              length;
+    size_t              next_length;
+    bool                deferred;
+
+
+    deferred = false;
+    while (inRemaining > 0 && !lzs_writer_full(pWriter))
+    {
+        if (!deferred)
+        {
+            length = lzs_find_match(pFinder, pConfig, inPtr, inRemaining, &offset, NULL, NULL);
+        }
+        deferred = false;
+        if (length < MIN_LENGTH)
+        {
+            lzs_put_literal(pWriter, *inPtr);
+            length = 1u;
+        }
+        else if (length < pConfig->lazyLength && length < inRemaining)
+        {
+            lzs_match_finder_insert(pFinder, inPtr, inRemaining);
+            next_length = lzs_find_match(pFinder, pConfig, inPtr + 1, inRemaining - 1, &next_offset, NULL, NULL);
+            if (next_length >= MIN_LENGTH &&
+                (LITERAL_BITS + lzs_match_price(next_offset, next_length)) * length <
+                lzs_match_price(offset, length) * (next_length + 1u))
             {
-                return outCount;
+                lzs_put_literal(pWriter, *inPtr);
+                inPtr++;
+                inRemaining--;
+                offset = next_offset;
+                length = next_length;
+                deferred = true;
+                continue;
             }
-            *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-            bitFieldQueueLen -= 8u;
-            outCount++;
+            lzs_put_match(pWriter, offset, length);
+            lzs_match_finder_skip(pFinder, inPtr + 1, inRemaining - 1, length - 1u);
+            inPtr += length;
+            inRemaining -= length;
+            continue;
         }
-        if (inRemaining == 0 && state == COMPRESS_NORMAL)
+        else
         {
-            /* Exit for loop when all input data is processed. */
-            break;
+            lzs_put_match(pWriter, offset, length);
         }
+        lzs_match_finder_skip(pFinder, inPtr, inRemaining, length);
+        inPtr += length;
+        inRemaining -= length;
+    }
+}
 
-        switch (state)
+/*
+ * Choose the cheapest sequence of tokens for each window of input.
+ *
+ * Each input position is priced in bits from the start of the window, taking a
+ * byte-literal or a match of any length up to the longest found. The cheapest
+ * path to the end of the window is then traced back and output. Positions
+ * covered by a match of nice length are not searched.
+ */
+static void lzs_parse_optimal(LzsMatchFinder_t * pFinder, LzsBitWriter_t * pWriter, const LzsLevelConfig_t * pConfig,
+                              const uint8_t * inPtr, size_t inRemaining)
+{
+    uint32_t            price[LZS_OPTIMAL_WINDOW + 1u];
+    uint16_t            tokenLength[LZS_OPTIMAL_WINDOW + 1u];
+    uint16_t            tokenOffset[LZS_OPTIMAL_WINDOW + 1u];
+    uint32_t            cost;
+    uint_fast16_t       offset;
+    uint_fast16_t       short_offset;
+    uint_fast16_t       temp16;
+    size_t              windowLen;
+    size_t              skipTo;
+    size_t              length;
+    size_t              short_length;
+    size_t              temp;
+    size_t              i;
+    size_t              j;
+
+
+    while (inRemaining > 0 && !lzs_writer_full(pWriter))
+    {
+        windowLen = LZSMIN(inRemaining, LZS_OPTIMAL_WINDOW);
+        price[0] = 0;
+        for (i = 1; i <= windowLen; i++)
         {
-            case COMPRESS_NORMAL:
-                /* Look for a match in history */
-                best_length = 0;
-                matchMax = LZSMIN(inRemaining, LZS_SEARCH_MATCH_MAX);
-                if (matchMax >= 2u)
-                {
-                    inputHash = inputs_hash(*inPtr, *(inPtr + 1));
-                    historyReadIdx = hashTable[inputHash];
-                    if (historyReadIdx < historyLen)
-                    {
-                        offset = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(historyHash));
+            price[i] = UINT32_MAX;
+        }
 
-                        for ( ; offset <= historyLen; )
-                        {
-                            length = lzs_match_len(inPtr, inPtr - offset, matchMax);
-                            if (length > best_length)
-                            {
-                                best_offset = offset;
-                                best_length = length;
-                                if (length >= matchMax)
-                                {
-                                    break;
-                                }
-                            }
+        skipTo = 0;
+        for (i = 0; i < windowLen; i++)
+        {
+            if (i < skipTo)
+            {
+                lzs_match_finder_insert(pFinder, inPtr + i, inRemaining - i);
+                continue;
+            }
+            cost = price[i] + LITERAL_BITS;
+            if (cost < price[i + 1u])
+            {
+                price[i + 1u] = cost;
+                tokenLength[i + 1u] = 1u;
+            }
 
-                            // Get next offset from historyHash[]
-                            // This involves calculating historyReadIdx to index into it.
-                            historyReadIdx = historyHash[historyReadIdx];
-                            if (historyReadIdx >= historyLen)
-                            {
-                                break;
-                            }
-                            // Calculate new offset.
-                            temp16 = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(historyHash));
-                            if (temp16 <= offset)
-                            {
-                                break;
-                            }
-                            offset = temp16;
-                        }
-                    }
-                }
-                /* Output */
-                if (best_length < MIN_LENGTH)
+            length = lzs_find_match(pFinder, pConfig, inPtr + i, inRemaining - i, &offset, &short_length, &short_offset);
+            lzs_match_finder_insert(pFinder, inPtr + i, inRemaining - i);
+            // Any length of a match is a match, so cut it at the end of the window.
+            length = LZSMIN(length, windowLen - i);
+            short_length = LZSMIN(short_length, windowLen - i);
+            for (j = MIN_LENGTH; j <= length; j++)
+            {
+                temp16 = (j <= short_length) ? short_offset : offset;
+                cost = price[i] + lzs_match_price(temp16, j);
+                if (cost < price[i + j])
                 {
-                    /* Byte-literal */
-                    /* Leading 0 bit indicates offset/length token.
-                     * Following 8 bits are byte-literal. */
-                    bitFieldQueue <<= 9u;
-                    bitFieldQueue |= *inPtr;
-                    bitFieldQueueLen += 9u;
-                    length = 1u;
-                    LZS_DEBUG(("Literal %c (%02X)\n", isprint(*inPtr) ? *inPtr : '?', *inPtr));
+                    price[i + j] = cost;
+                    tokenLength[i + j] = j;
+                    tokenOffset[i + j] = temp16;
                 }
-                else
-                {
-                    LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
-                    /* Offset/length token */
-                    /* 1 bit indicates offset/length token */
-                    bitFieldQueue <<= 1u;
-                    bitFieldQueueLen++;
-                    bitFieldQueue |= 1u;
-                    /* Encode offset */
-                    if (best_offset <= SHORT_OFFSET_MAX)
-                    {
-                        /* Short offset */
-                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
-                        /* Initial 1 bit indicates short offset */
-                        bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
-                    }
-                    else
-                    {
-                        /* Long offset */
-                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
-                        /* Initial 0 bit indicates long offset */
-                        bitFieldQueue |= best_offset;
-                        bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
-                    }
-                    /* Encode length */
-                    length = LZSMIN(best_length, MAX_SHORT_LENGTH);
-                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    bitFieldQueue <<= temp8;
-                    bitFieldQueue |= length_value[length];
-                    bitFieldQueueLen += temp8;
+            }
+            if (length >= pConfig->niceLength)
+            {
+                skipTo = i + length;
+            }
+        }
 
-                    if (length == MAX_SHORT_LENGTH)
-                    {
-                        state = COMPRESS_EXTENDED;
-                    }
-                }
-                break;
-            case COMPRESS_EXTENDED:
-                matchMax = LZSMIN(inRemaining, MAX_EXTENDED_LENGTH);
-                length = lzs_match_len(inPtr, inPtr - best_offset, matchMax);
-                LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
+        /* Trace back from the end of the window, turning each token to be
+         * stored at its start position instead of its end position. */
+        length = 0;
+        offset = 0;
+        for (i = windowLen; i > 0; i -= temp)
+        {
+            temp = tokenLength[i];
+            temp16 = tokenOffset[i];
+            tokenLength[i] = length;
+            tokenOffset[i] = offset;
+            length = temp;
+            offset = temp16;
+        }
+        tokenLength[0] = length;
+        tokenOffset[0] = offset;
 
-                /* Encode length */
-                bitFieldQueue <<= EXTENDED_LENGTH_BITS;
-                bitFieldQueue |= length;
-                bitFieldQueueLen += EXTENDED_LENGTH_BITS;
+        for (i = 0; i < windowLen; i += tokenLength[i])
+        {
+            if (tokenLength[i] == 1u)
+            {
+                lzs_put_literal(pWriter, inPtr[i]);
+            }
+            else
+            {
+                lzs_put_match(pWriter, tokenOffset[i], tokenLength[i]);
+            }
+        }
+        inPtr += windowLen;
+        inRemaining -= windowLen;
+    }
+}
 
-                if (length != MAX_EXTENDED_LENGTH)
+
+// Hash of 3 input bytes, modulo FAST_HASH_SIZE.
+static inline uint_fast16_t fast_hash(const uint8_t * inPtr)
+{
+    uint32_t            value;
+
+
+    value = ((uint32_t)inPtr[0] << 16u) | ((uint32_t)inPtr[1] << 8u) | inPtr[2];
+    return (uint_fast16_t)((value * 2654435761u) >> (32u - FAST_HASH_BITS));
+}
+
+/*
+ * Take the match at the latest input position of the same hash, if there is one.
+ *
+ * Hash table is probed once per position. Each failed probe in a row increases
+ * the count of literals emitted before the next probe, so incompressible input
+ * is passed through with few probes.
+ */
+static void lzs_parse_fast(LzsBitWriter_t * pWriter, const uint8_t * a_pInData, size_t a_inLen)
+{
+    uint32_t            hashTable[FAST_HASH_SIZE];
+    uint_fast16_t       inputHash;
+    size_t              inPos;
+    size_t              candidate;
+    size_t              offset;
+    size_t              length;
+    size_t              misses;
+    size_t              literals;
+
+
+    memset(hashTable, 0, sizeof(hashTable));
+    inPos = 0;
+    misses = 0;
+    while (inPos < a_inLen && !lzs_writer_full(pWriter))
+    {
+        if (a_inLen - inPos >= 3u)
+        {
+            inputHash = fast_hash(a_pInData + inPos);
+            candidate = hashTable[inputHash];
+            hashTable[inputHash] = (uint32_t)inPos;
+            // Table holds low 32 bits of positions, a wrapped one is a mismatch at worst.
+            offset = (inPos - candidate) & 0xFFFFFFFFu;
+            if (offset > 0 && offset <= LZS_MAX_HISTORY_SIZE && offset <= inPos)
+            {
+                length = lzs_match_len(a_pInData + inPos, a_pInData + inPos - offset, a_inLen - inPos);
+                if (length >= MIN_LENGTH)
                 {
-                    state = COMPRESS_NORMAL;
+                    lzs_put_match(pWriter, (uint_fast16_t)offset, length);
+                    // Positions inside the match are added too, they cost a hash each.
+                    for (candidate = inPos + 1u; candidate < inPos + length && a_inLen - candidate >= 3u; candidate++)
+                    {
+                        hashTable[fast_hash(a_pInData + candidate)] = (uint32_t)candidate;
+                    }
+                    inPos += length;
+                    misses = 0;
+                    continue;
                 }
-                break;
+            }
         }
-        // 'length' contains number of input bytes encoded.
-        // Update inPtr, inRemaining and hash tables accordingly.
-        for (temp8 = 0; temp8 < length; temp8++)
+        literals = LZSMIN(1u + (misses >> FAST_SKIP_SHIFT), a_inLen - inPos);
+        misses++;
+        for ( ; literals > 0; literals--)
         {
-            inputHash = inputs_hash(*inPtr, *(inPtr + 1));
-            inPtr++;
-
-            historyHash[historyLatestIdx] = hashTable[inputHash];
-            hashTable[inputHash] = historyLatestIdx;
-            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, ARRAY_ENTRIES(historyHash));
+            lzs_put_literal(pWriter, a_pInData[inPos++]);
         }
+    }
+}
 
-        inRemaining -= length;
 
-        historyLen = LZSMIN(historyLen + length, LZS_MAX_HISTORY_SIZE);
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Single-call compression
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ */
+size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return lzs_compress_level(a_pOutData, a_outBufferSize, a_pInData, a_inLen, LZS_LEVEL_DEFAULT);
+}
+
+/*
+ * Single-call compression at a compression level
+ *
+ * Level is clamped to LZS_LEVEL_MIN..LZS_LEVEL_MAX. Higher levels produce smaller
+ * output at lower speed. Output of every level is a standard LZS stream.
+ */
+size_t lzs_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, int a_level)
+{
+    LzsMatchFinder_t            finder;
+    LzsBitWriter_t              writer;
+    const LzsLevelConfig_t    * pConfig;
+
+
+    if (a_level < (int)LZS_LEVEL_MIN)
+    {
+        a_level = LZS_LEVEL_MIN;
+    }
+    else if (a_level > (int)LZS_LEVEL_MAX)
+    {
+        a_level = LZS_LEVEL_MAX;
+    }
+    pConfig = &level_config[a_level - LZS_LEVEL_MIN];
+
+    if (pConfig->parse != PARSE_FAST)
+    {
+        lzs_match_finder_init(&finder);
     }
+    writer.outPtr = a_pOutData;
+    writer.outCount = 0;
+    writer.outBufferSize = a_outBufferSize;
+    writer.bitFieldQueue = 0;
+    writer.bitFieldQueueLen = 0;
+
+    switch (pConfig->parse)
+    {
+        case PARSE_FAST:
+            lzs_parse_fast(&writer, a_pInData, a_inLen);
+            break;
+        case PARSE_GREEDY:
+            lzs_parse_greedy(&finder, &writer, pConfig, a_pInData, a_inLen);
+            break;
+        case PARSE_LAZY:
+            lzs_parse_lazy(&finder, &writer, pConfig, a_pInData, a_inLen);
+            break;
+        case PARSE_OPTIMAL:
+            lzs_parse_optimal(&finder, &writer, pConfig, a_pInData, a_inLen);
+            break;
+    }
+
     /* Make end marker, which is like a short offset with value 0, padded out
      * with 0 to 7 extra zeros to reach a byte boundary. That is,
      * 0b110000000 */
-    bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
-    /* Copy output bits to output buffer */
-    while (bitFieldQueueLen >= 8u)
-    {
-        if (outCount >= a_outBufferSize)
-        {
-            return outCount;
-        }
-        *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-        bitFieldQueueLen -= 8u;
-        outCount++;
-    }
-    return outCount;
+    lzs_put_bits(&writer, 3u << (SHORT_OFFSET_BITS + 7u), 2u + SHORT_OFFSET_BITS + 7u);
+    return writer.outCount;
 }
 
 /*
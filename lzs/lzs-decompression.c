@@ -47,6 +47,7 @@
 #include "lzs-common.h"
 
 #include <stdint.h>
+#include <string.h>
 
 //#include <inttypes.h>
 //#include <ctype.h>
@@ -62,6 +63,11 @@
 // Choose which method to use
 #define LENGTH_DECODE_METHOD        LENGTH_DECODE_METHOD_TABLE
 
+// Decode with 64-bit bit reader while at least 8 bytes of input remain
+#ifndef LZS_FAST_DECODE
+#define LZS_FAST_DECODE             1
+#endif
+
 //#define LZS_DEBUG(X)    printf X
 #define LZS_DEBUG(X)
 
@@ -98,8 +104,6 @@ typedef enum
  * Tables
  ****************************************************************************/
 
-#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
-
 static const uint8_t lengthDecodeTable[(1u << LENGTH_MAX_BIT_WIDTH)] =
 {
     /* Length is encoded as:
@@ -118,7 +122,89 @@ static const uint8_t lengthDecodeTable[(1u << LENGTH_MAX_BIT_WIDTH)] =
     0x42, 0x42, 0x42, 0x42,     // 0b10 --> 4
     0x54, 0x64, 0x74, 0x84,     // 0b11xy --> 5, 6, 7, and also 8 (see MAX_SHORT_LENGTH) which goes into extended lengths
 };
+
+
+#if LZS_FAST_DECODE
+
+// Match copies write whole 8 byte chunks
+#define ALIGN8(X)                   (((X) + 7u) & ~7u)
+
+// Token type and offset class, by the top 2 bits of the token:
+//  0bx0, 0bx1 --> literal (0b0 followed by 8 bits)
+//  0b10 --> long offset
+//  0b11 --> short offset
+// High nibble is the offset bit width (0 for literal), low nibble is the token type bit width.
+static const uint8_t tokenDecodeTable[4] =
+{
+    0x01, 0x01,
+    (LONG_OFFSET_BITS << 4u) | 2u,
+    (SHORT_OFFSET_BITS << 4u) | 2u,
+};
+
+static inline uint64_t load_be64(const uint8_t * p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    value = __builtin_bswap64(value);
+#elif !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ != __ORDER_BIG_ENDIAN__)
+    value = ((uint64_t)p[0] << 56u) | ((uint64_t)p[1] << 48u) | ((uint64_t)p[2] << 40u) | ((uint64_t)p[3] << 32u) |
+            ((uint64_t)p[4] << 24u) | ((uint64_t)p[5] << 16u) | ((uint64_t)p[6] << 8u) | (uint64_t)p[7];
 #endif
+    return value;
+}
+
+// Offset adjustments which turn offsets below 8 into a multiple of the offset of at least 8,
+// after the first 8 bytes of the pattern were written
+static const uint8_t patternInc[8] = { 0, 1, 2, 1, 0, 4, 4, 4 };
+static const int8_t patternDec[8] = { 0, 0, 0, -1, -4, 1, 2, 3 };
+
+// Copy (offset, length) bytes in 8 byte chunks.
+// Caller must have checked there is space for length rounded up to a multiple of 8.
+// Trusted data is known to keep offsets within the history, see lzs_decompress_validate.
+static inline uint8_t * copy_match(uint8_t * outPtr, const uint8_t * a_pOutData, uint_fast16_t offset, uint_fast8_t length, bool a_trusted)
+{
+    const uint8_t     * srcPtr = outPtr - offset;
+    uint8_t           * endPtr = outPtr + length;
+    uint_fast8_t        i;
+
+    if (!a_trusted && offset > (size_t)(outPtr - a_pOutData))
+    {
+        // Offset is outside of valid history, write zeros. Avoid information leak.
+        for (i = 0; i < length; i++)
+        {
+            outPtr[i] = (outPtr + i - offset >= a_pOutData) ? outPtr[i - offset] : 0;
+        }
+        return endPtr;
+    }
+    if (offset < 8u)
+    {
+        // Replicate the short pattern
+        outPtr[0] = srcPtr[0];
+        outPtr[1] = srcPtr[1];
+        outPtr[2] = srcPtr[2];
+        outPtr[3] = srcPtr[3];
+        srcPtr += patternInc[offset];
+        memcpy(outPtr + 4, srcPtr, 4);
+        srcPtr -= patternDec[offset];
+    }
+    else
+    {
+        memcpy(outPtr, srcPtr, 8);
+        srcPtr += 8;
+    }
+    outPtr += 8;
+    // Source is at least 8 bytes behind, so chunks never overlap
+    while (outPtr < endPtr)
+    {
+        memcpy(outPtr, srcPtr, 8);
+        outPtr += 8;
+        srcPtr += 8;
+    }
+    return endPtr;
+}
+
+#endif // LZS_FAST_DECODE
 
 
 static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
@@ -145,8 +231,11 @@ static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
  * No state is kept between calls. Decompression is expected to complete in a single call.
  * It will stop if/when it reaches the end of either the input or the output buffer,
  * or when it reaches an end-marker.
+ *
+ * Hot loop runs unchecked while input and output are more than a worst-case token away
+ * from their ends, then hands over to the checked loop.
  */
-size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+static inline size_t decompress_single(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, bool a_trusted)
 {
     const uint8_t     * inPtr;
     uint8_t           * outPtr;
@@ -168,12 +257,92 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
     outCount = 0;
     state = DECOMPRESS_NORMAL;
 
+#if LZS_FAST_DECODE
+    {
+        // Fast path, which needs no input checks between refills, and checks output space once per token.
+        // It stops near the end of either buffer, and hands over to the checked loop below.
+        const uint8_t     * inEnd = a_pInData + a_inLen;
+        uint8_t           * outEnd = a_pOutData + a_outBufferSize;
+        uint64_t            bits = 0;       // MS-bit aligned, next bit is bit 63
+        uint_fast8_t        bitCount = 0;
+        uint_fast8_t        token;
+
+        while (inEnd - inPtr >= 8)
+        {
+            // Refill to at least 56 bits. Whole bytes consumed by the queue are skipped in the input.
+            bits |= load_be64(inPtr) >> bitCount;
+            inPtr += (63u - bitCount) >> 3u;
+            bitCount |= 56u;
+
+            if (state == DECOMPRESS_EXTENDED)
+            {
+                if ((size_t)(outEnd - outPtr) < ALIGN8(MAX_EXTENDED_LENGTH))
+                {
+                    break;
+                }
+                length = (uint_fast8_t) (bits >> (64u - LENGTH_MAX_BIT_WIDTH));
+                bits <<= LENGTH_MAX_BIT_WIDTH;
+                bitCount -= LENGTH_MAX_BIT_WIDTH;
+                outPtr = copy_match(outPtr, a_pOutData, offset, length, a_trusted);
+                if (length != MAX_EXTENDED_LENGTH)
+                {
+                    state = DECOMPRESS_NORMAL;
+                }
+                continue;
+            }
+            if ((size_t)(outEnd - outPtr) < ALIGN8(MAX_SHORT_LENGTH))
+            {
+                break;
+            }
+            token = tokenDecodeTable[bits >> 62u];
+            if ((token >> 4u) == 0)
+            {
+                // Literal
+                *outPtr++ = (uint8_t) (bits >> 55u);
+                bits <<= 9u;
+                bitCount -= 9u;
+                continue;
+            }
+            offset = (uint_fast16_t) ((bits << 2u) >> (64u - (token >> 4u)));
+            if (offset == 0)
+            {
+                if ((token >> 4u) == SHORT_OFFSET_BITS)
+                {
+                    LZS_DEBUG(("End marker\n"));
+                    return outPtr - a_pOutData;
+                }
+                // Long offset of zero copies nothing, same as the checked loop
+                bits <<= 2u + LONG_OFFSET_BITS;
+                bitCount -= 2u + LONG_OFFSET_BITS;
+                continue;
+            }
+            temp8 = lengthDecodeTable[(bits << (2u + (token >> 4u))) >> (64u - LENGTH_MAX_BIT_WIDTH)];
+            length = temp8 >> 4u;
+            temp8 = 2u + (token >> 4u) + (temp8 & 0xF);
+            bits <<= temp8;
+            bitCount -= temp8;
+            outPtr = copy_match(outPtr, a_pOutData, offset, length, a_trusted);
+            if (length == MAX_SHORT_LENGTH)
+            {
+                // We must go into extended length decode mode
+                state = DECOMPRESS_EXTENDED;
+            }
+        }
+        // Return whole unconsumed bytes to the input, keep the remaining bits in the bit field queue
+        inPtr -= bitCount >> 3u;
+        bitFieldQueueLen = bitCount & 7u;
+        bitFieldQueue = (uint32_t) (bits >> 32u) & ~(UINT32_MAX >> bitFieldQueueLen);
+        inRemaining = inEnd - inPtr;
+        outCount = outPtr - a_pOutData;
+    }
+#endif
+
     for (;;)
     {
         // Load input data into the bit field queue
         while ((inRemaining > 0) && (bitFieldQueueLen <= BIT_QUEUE_BITS - 8u))
         {
-            bitFieldQueue |= (*inPtr++ << (BIT_QUEUE_BITS - 8u - bitFieldQueueLen));
+            bitFieldQueue |= ((uint32_t)*inPtr++ << (BIT_QUEUE_BITS - 8u - bitFieldQueueLen));
             bitFieldQueueLen += 8u;
             //LZS_DEBUG(("Load queue: %04X\n", bitFieldQueue));
             inRemaining--;
@@ -405,6 +574,133 @@ finish:
 }
 
 
+size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return decompress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, false);
+}
+
+
+/*
+ * Single-call decompression of data, which passed lzs_decompress_validate.
+ *
+ * The hot loop skips match offset checks against the decoded history.
+ */
+size_t lzs_decompress_trusted(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return decompress_single(a_pOutData, a_outBufferSize, a_pInData, a_inLen, true);
+}
+
+
+/*
+ * Check that compressed data decodes to exactly a_outLen bytes, and that every
+ * match offset is within the decoded history. Nothing is written.
+ */
+bool lzs_decompress_validate(const uint8_t * a_pInData, size_t a_inLen, size_t a_outLen)
+{
+    const uint8_t     * inPtr = a_pInData;
+    size_t              inRemaining = a_inLen;
+    size_t              outCount = 0;
+    uint32_t            bitFieldQueue = 0;
+    uint_fast8_t        bitFieldQueueLen = 0;
+    uint_fast16_t       offset = 0;
+    uint_fast8_t        length;
+    uint8_t             temp8;
+    bool                extended = false;
+
+    for (;;)
+    {
+        // Load input data into the bit field queue
+        while ((inRemaining > 0) && (bitFieldQueueLen <= BIT_QUEUE_BITS - 8u))
+        {
+            bitFieldQueue |= ((uint32_t)*inPtr++ << (BIT_QUEUE_BITS - 8u - bitFieldQueueLen));
+            bitFieldQueueLen += 8u;
+            inRemaining--;
+        }
+        if (extended)
+        {
+            if (bitFieldQueueLen < LENGTH_MAX_BIT_WIDTH)
+            {
+                break;
+            }
+            length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH));
+            bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
+            bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
+            if (length > a_outLen - outCount)
+            {
+                return false;
+            }
+            outCount += length;
+            extended = (length == MAX_EXTENDED_LENGTH);
+            continue;
+        }
+        // Incomplete tokens are trailing padding, the decoder stops there as well
+        if (bitFieldQueueLen < 9u)
+        {
+            break;
+        }
+        if (!(bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))))
+        {
+            // Literal
+            bitFieldQueue <<= 9u;
+            bitFieldQueueLen -= 9u;
+            if (outCount == a_outLen)
+            {
+                return false;
+            }
+            outCount++;
+            continue;
+        }
+        if (bitFieldQueue & (1u << (BIT_QUEUE_BITS - 2u)))
+        {
+            // Short offset
+            offset = (bitFieldQueue << 2u) >> (BIT_QUEUE_BITS - SHORT_OFFSET_BITS);
+            bitFieldQueue <<= 2u + SHORT_OFFSET_BITS;
+            bitFieldQueueLen -= 2u + SHORT_OFFSET_BITS;
+            if (offset == 0)
+            {
+                // End marker
+                return outCount == a_outLen;
+            }
+        }
+        else
+        {
+            // Long offset
+            if (bitFieldQueueLen < 2u + LONG_OFFSET_BITS)
+            {
+                break;
+            }
+            offset = (bitFieldQueue << 2u) >> (BIT_QUEUE_BITS - LONG_OFFSET_BITS);
+            bitFieldQueue <<= 2u + LONG_OFFSET_BITS;
+            bitFieldQueueLen -= 2u + LONG_OFFSET_BITS;
+            if (offset == 0)
+            {
+                continue;
+            }
+        }
+        if (offset > outCount)
+        {
+            return false;
+        }
+        temp8 = lengthDecodeTable[(uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH))];
+        length = temp8 >> 4u;
+        temp8 &= 0xF;
+        if (bitFieldQueueLen < temp8)
+        {
+            break;
+        }
+        bitFieldQueue <<= temp8;
+        bitFieldQueueLen -= temp8;
+        if (length > a_outLen - outCount)
+        {
+            return false;
+        }
+        outCount += length;
+        extended = (length == MAX_SHORT_LENGTH);
+    }
+    return outCount == a_outLen;
+}
+
+
 /*
  * \brief Initialise incremental decompression
  */
@@ -80,6 +80,15 @@
 // size X. Worst case is 16 times original size.
 #define LZS_DECOMPRESSED_MAX(X)     ((X) * 16u)
 
+// Compression levels of lzs_compress_level(). The default level is the greedy
+// parse of lzs_compress(), higher levels use lazy and then optimal parsing.
+// The fast level probes a single hash slot per position and skips ahead over
+// incompressible input.
+#define LZS_LEVEL_MIN               0u
+#define LZS_LEVEL_FAST              0u
+#define LZS_LEVEL_DEFAULT           1u
+#define LZS_LEVEL_MAX               9u
+
 
 /*****************************************************************************
  * Typedefs
@@ -215,6 +224,7 @@ typedef struct
  ****************************************************************************/
 
 size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+size_t lzs_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, int a_level);
 
 void lzs_compress_init_quick(LzsCompressParameters_t * pParams);
 void lzs_compress_init_full(LzsCompressParameters_t * pParams);
@@ -225,7 +235,13 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
 void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams);
 size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams, bool add_end_marker);
 
+/*
+ * Output bytes past the returned size, within a_outBufferSize, may be overwritten
+ * by the wide match copy.
+ */
 size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+size_t lzs_decompress_trusted(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+bool lzs_decompress_validate(const uint8_t * a_pInData, size_t a_inLen, size_t a_outLen);
 
 void lzs_decompress_init(LzsDecompressParameters_t * pParams);
 size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams);
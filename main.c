@@ -12,6 +12,8 @@
 #define OK 0
 #define NOT_OK 1
 #define LIB_ERR -1
+/* input bytes read into memory before they are written as one batch */
+#define BATCH_SIZE (16 * 1024 * 1024)
 
 int readFile(const char *name, void **output, int *size) 
 {
@@ -85,12 +87,15 @@ int esnurePath(const char *path) {
 }
 
 int writeArchive(int argc, const char **argv) {
-	int i, rsize, wsize, psize;
+	int i, j, count, psize, first, batchSize;
+	int status = OK;
 	int totalSize = 0;
 	float compression;
 	zpak_t *pak;
+	zpak_write_entry_t *entries;
+	int *compSizes;
 	void *buffer;
-	const char *output, *input;
+	const char *output;
 	/* we need minimum two files (input and output) */
 	if (argc < 2) {
 		fprintf(stderr, "%s\n", "ERROR: expected at least one input and output");
@@ -102,29 +107,63 @@ int writeArchive(int argc, const char **argv) {
 		perror(output);
 		return NOT_OK;
 	}
-	pak = zpak_construct(NULL, NULL, ZPAK_F_WRITE | ZPAK_F_LZS);
+	pak = zpak_construct(NULL, NULL, ZPAK_F_WRITE | ZPAK_F_LZS | ZPAK_F_DIRECTORY | ZPAK_F_NAME_INDEX);
 	if (!pak) {
 		fprintf(stderr, "ERROR: could not init zpak");
 		return NOT_OK;
 	}
-	fprintf(stdout, "INFO: archiving %i files\n", argc - 1);
-	for (i = 0; i < argc - 1; ++i) {
-		input = argv[i];
-		if (readFile(input, &buffer, &rsize) == NOT_OK) {
-			zpak_destruct(pak);
-			return NOT_OK;
+	/* compress files on all cores */
+	zpak_set_threads(pak, 0);
+	count = argc - 1;
+	entries = calloc(count, sizeof(zpak_write_entry_t));
+	compSizes = malloc(count * sizeof(int));
+	if (!entries || !compSizes) {
+		fprintf(stderr, "ERROR: could not allocate entries\n");
+		free(entries);
+		free(compSizes);
+		zpak_destruct(pak);
+		return NOT_OK;
+	}
+	fprintf(stdout, "INFO: archiving %i files\n", count);
+	/* files are read and written in batches, so that only a batch is held in memory */
+	first = 0;
+	batchSize = 0;
+	for (i = 0; i < count && status == OK; ++i) {
+		entries[i].name = argv[i];
+		if (readFile(argv[i], &buffer, &entries[i].size) == NOT_OK) {
+			status = NOT_OK;
+			break;
+		}
+		entries[i].data = buffer;
+		batchSize += entries[i].size;
+		if (batchSize < BATCH_SIZE && i + 1 < count) {
+			continue;
 		}
-		wsize = zpak_write(pak, input, buffer, rsize);
-		if (wsize == LIB_ERR) {
+		if (zpak_write_batch(pak, entries + first, i + 1 - first, compSizes + first) == LIB_ERR) {
 			fprintf(stderr, "ERROR: %s\n", zpak_get_last_error(pak));
-			zpak_destruct(pak);
-			free(buffer);
-			return NOT_OK;
+			status = NOT_OK;
 		}
-		totalSize += wsize;
-		compression = (1.f - (float)wsize / (float)rsize) * 100.f;
-		free(buffer);
-		fprintf(stdout, "    LZS %i/%i comp %02f%c %s\n", wsize, rsize, compression, '%', input);
+		for (j = first; j <= i; ++j) {
+			if (status == OK) {
+				totalSize += compSizes[j];
+				compression = (1.f - (float)compSizes[j] / (float)entries[j].size) * 100.f;
+				fprintf(stdout, "    LZS %i/%i comp %02f%c %s\n", compSizes[j], entries[j].size, compression, '%', entries[j].name);
+			}
+			free((void*)entries[j].data);
+			entries[j].data = NULL;
+		}
+		first = i + 1;
+		batchSize = 0;
+	}
+	/* files of unfinished batch */
+	for (j = first; j < count; ++j) {
+		free((void*)entries[j].data);
+	}
+	free(entries);
+	free(compSizes);
+	if (status == NOT_OK) {
+		zpak_destruct(pak);
+		return NOT_OK;
 	}
 	psize = zpak_write_end(pak, (void**)&buffer);
 	if (writeFile(output, buffer, psize) == NOT_OK) {
@@ -161,9 +200,9 @@ int listArchive(int argc, const char **argv)
 		return NOT_OK;
 	}
 	if (zpak_load_static_data(pak, buffer, size) == LIB_ERR) {
+		fprintf(stderr, "ERROR: %s\n", zpak_get_last_error(pak));
 		free(buffer);
 		zpak_destruct(pak);
-		fprintf(stderr, "ERROR: %s\n", zpak_get_last_error(pak));
 		return NOT_OK;
 	}
 	
@@ -174,18 +213,14 @@ int listArchive(int argc, const char **argv)
 		fprintf(stderr, "ERROR: could not allocate iterator");
 		return NOT_OK;
 	}
-	while (zpak_it_next(it)) {
-		const char *entryName = zpak_it_get_entry_name(it);
-		/* filter */
-		if (argc > 1) {
-			for (i = 0; i < argc - 1; ++i) {
-				input = argv[i];
-				if (strncmp(entryName, input, 256) == 0) {
-					printf("    LZS %ib %s\n", zpak_it_get_entry_size(it), entryName);
-				}
-			}
-		} else {
-			printf("    LZS %ib %s\n", zpak_it_get_entry_size(it), entryName);
+	/* filters are matched as name prefixes, no filter lists everything */
+	for (i = 0; i < (argc > 1 ? argc - 1 : 1); ++i) {
+		input = argc > 1 ? argv[i] : "";
+		if (zpak_list_prefix(pak, input, it) == LIB_ERR) {
+			break;
+		}
+		while (zpak_it_next(it)) {
+			printf("    LZS %ib %s\n", zpak_it_get_entry_size(it), zpak_it_get_entry_name(it));
 		}
 	}
 	zpak_it_destruct(it);
@@ -6,10 +6,19 @@
 #include <time.h>
 
 #include "zpak.h"
+#include "lzs/lzs.h"
 
+#if defined(ZPAK_THREADS) && !defined(_WIN32)
+	#include <pthread.h>
+	#define BENCH_THREADS
+#endif
+
+// wall clock, cpu time of multithreaded benchmarks sums up all threads
 double get_time()
 {
-    return (double)clock() / CLOCKS_PER_SEC;
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
 }
 
 double benchmark_entry_search(int n)
@@ -42,10 +51,394 @@ double benchmark_entry_search(int n)
 	return end - start;
 }
 
+// average lookup time of the last written entry, with and without name hash column
+double benchmark_hash_column_search(int n, int flags)
+{
+	static char path[MAX_PATH];
+	const char *data = "Nunc leo velit, feugiat sit amet ornare at, sodales nec velit. Nulla sed hendrerit orci.";
+	int dataLength = strlen(data) + 1;
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | flags);
+	for (int i = 0; i < n; i++)
+	{
+		snprintf(path, MAX_PATH, "assets/textures/level%i/texture%i.png", i % 16, i);
+		int writeSize = zpak_write(zpak, path, data, dataLength);
+		assert(writeSize == dataLength);
+	}
+	void *blob;
+	int blobSize = zpak_write_end(zpak, &blob);
+	assert(blobSize > 0);
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, blob, blobSize);
+	assert(result == 0);
+	const int lookups = 100;
+	double start = get_time();
+	for (int i = 0; i < lookups; i++)
+	{
+		zpak_handle_t handle = zpak_find(zpak2, path);
+		assert(handle != 0);
+	}
+	double end = get_time();
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(blob);
+	return (end - start) / lookups;
+}
+
+// average lookup time of missing entries
+double benchmark_missing_lookup(int n, int flags)
+{
+	static char path[MAX_PATH];
+	const char *data = "Nunc leo velit";
+	int dataLength = strlen(data) + 1;
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | flags);
+	for (int i = 0; i < n; i++)
+	{
+		snprintf(path, MAX_PATH, "scripts/modules/module%i.js", i);
+		zpak_write(zpak, path, data, dataLength);
+	}
+	void *blob;
+	int blobSize = zpak_write_end(zpak, &blob);
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, blob, blobSize);
+	assert(result == 0);
+	const int lookups = 1000;
+	double start = get_time();
+	for (int i = 0; i < lookups; i++)
+	{
+		snprintf(path, MAX_PATH, "lib/modules/module%i.js", i);
+		zpak_find(zpak2, path);
+	}
+	double end = get_time();
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(blob);
+	return (end - start) / lookups;
+}
+
+// average directory lookup time of long entry paths, with given name hash
+double benchmark_long_path_lookup(int n, int flags)
+{
+	static char path[256];
+	const char *data = "Nunc leo velit";
+	int dataLength = strlen(data) + 1;
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_DIRECTORY | flags);
+	for (int i = 0; i < n; i++)
+	{
+		snprintf(path, sizeof(path), "assets/environment/models/buildings/residential/district%i/"
+			"block%i/variants/lod0/materials/textures/albedo/texture%i.png", i % 7, i % 13, i);
+		zpak_write(zpak, path, data, dataLength);
+	}
+	void *blob;
+	int blobSize = zpak_write_end(zpak, &blob);
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, blob, blobSize);
+	assert(result == 0);
+	const int lookups = 1000000;
+	double start = get_time();
+	for (int i = 0; i < lookups; i++)
+	{
+		zpak_handle_t handle = zpak_find(zpak2, path);
+		assert(handle != 0);
+	}
+	double end = get_time();
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(blob);
+	return (end - start) / lookups;
+}
+
+// fills buffer with text-like data, words drawn from small dictionary
+void fill_text(char *buffer, int size)
+{
+	static const char *words[] = { "local ", "function ", "return ", "end\n", "if ", "then ", "self.", "value", 
+		" = ", "nil", "(", ")", ", ", "table.insert", "for i = 1, #items do\n", "\t", "count", "name" };
+	int wordCount = sizeof(words) / sizeof(words[0]);
+	int cursor = 0;
+	while (cursor < size)
+	{
+		const char *word = words[rand() % wordCount];
+		while (*word && cursor < size)
+			buffer[cursor++] = *word++;
+	}
+}
+
+// decompression throughput of LZS entry in MB/s
+double benchmark_decompression(int size)
+{
+	char *data = malloc(size);
+	char *output = malloc(size);
+	fill_text(data, size);
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	int writeSize = zpak_write(zpak, "data", data, size);
+	assert(writeSize > 0);
+	zpak_handle_t handle = zpak_find(zpak, "data");
+	const int rounds = 20;
+	double start = get_time();
+	for (int i = 0; i < rounds; i++)
+	{
+		int readSize = zpak_handle_read_buf(zpak, handle, output, size);
+		assert(readSize == size);
+	}
+	double end = get_time();
+	assert(memcmp(data, output, size) == 0);
+	zpak_destruct(zpak);
+	free(output);
+	free(data);
+	return (double)size * rounds / (1024.0 * 1024.0) / (end - start);
+}
+
+double benchmark_range_read(int size, int flags)
+{
+	char *data = malloc(size);
+	char range[4096];
+	fill_text(data, size);
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | flags);
+	int writeSize = zpak_write(zpak, "data", data, size);
+	assert(writeSize > 0);
+	const int rounds = 20;
+	double start = get_time();
+	for (int i = 0; i < rounds; i++)
+	{
+		unsigned int offset = (unsigned int)(size - sizeof(range)) / rounds * i;
+		int readSize = zpak_read_range(zpak, "data", offset, sizeof(range), range);
+		assert(readSize == sizeof(range));
+		assert(memcmp(data + offset, range, sizeof(range)) == 0);
+	}
+	double end = get_time();
+	zpak_destruct(zpak);
+	free(data);
+	return (end - start) / rounds;
+}
+
+// returns compression and decompression MB/s of single chunked entry
+void benchmark_parallel_chunked(int size, int threads, double *compSpeed, double *decompSpeed)
+{
+	char *data = malloc(size);
+	char *output = malloc(size);
+	fill_text(data, size);
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED);
+	zpak_set_threads(zpak, threads);
+	double start = get_time();
+	int writeSize = zpak_write(zpak, "data", data, size);
+	double end = get_time();
+	assert(writeSize > 0);
+	*compSpeed = (double)size / (1024.0 * 1024.0) / (end - start);
+	zpak_handle_t handle = zpak_find(zpak, "data");
+	start = get_time();
+	int readSize = zpak_handle_read_buf(zpak, handle, output, size);
+	end = get_time();
+	assert(readSize == size);
+	assert(memcmp(data, output, size) == 0);
+	*decompSpeed = (double)size / (1024.0 * 1024.0) / (end - start);
+	zpak_destruct(zpak);
+	free(output);
+	free(data);
+}
+
+// lzs compression throughput of text corpus in MB/s, simple compressor with simple set
+double benchmark_lzs_compression(int size, int simple)
+{
+	uint8_t *data = malloc(size);
+	size_t outputSize = LZS_COMPRESSED_MAX(size);
+	uint8_t *output = malloc(outputSize);
+	fill_text((char*)data, size);
+	const int rounds = 5;
+	double start = get_time();
+	for (int i = 0; i < rounds; i++)
+	{
+		size_t compSize = simple ? lzs_simple_compress(output, outputSize, data, size) : lzs_compress(output, outputSize, data, size);
+		assert(compSize > 0 && compSize < (size_t)size);
+	}
+	double end = get_time();
+	free(output);
+	free(data);
+	return (double)size * rounds / (1024.0 * 1024.0) / (end - start);
+}
+
+// compression throughput in MB/s and compressed size ratio of text entry at compression level
+void benchmark_compression_level(int size, int level, double *compSpeed, double *ratio)
+{
+	char *data = malloc(size);
+	fill_text(data, size);
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_set_level(zpak, level);
+	double start = get_time();
+	int writeSize = zpak_write(zpak, "data", data, size);
+	double end = get_time();
+	assert(writeSize > 0);
+	*compSpeed = (double)size / (1024.0 * 1024.0) / (end - start);
+	*ratio = (double)writeSize / size;
+	zpak_destruct(zpak);
+	free(data);
+}
+
+// throughput in MB/s of writing many small text entries at once
+double benchmark_batch_write(int count, int size, int threads)
+{
+	char *data = malloc(count * size);
+	fill_text(data, count * size);
+	zpak_write_entry_t *entries = malloc(count * sizeof(zpak_write_entry_t));
+	char (*names)[32] = malloc(count * sizeof(*names));
+	for (int i = 0; i < count; i++)
+	{
+		sprintf(names[i], "dir/file%i.lua", i);
+		entries[i].name = names[i];
+		entries[i].data = data + i * size;
+		entries[i].size = size;
+	}
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_set_threads(zpak, threads);
+	double start = get_time();
+	int written = zpak_write_batch(zpak, entries, count, NULL);
+	double end = get_time();
+	assert(written == count);
+	zpak_destruct(zpak);
+	free(names);
+	free(entries);
+	free(data);
+	return (double)count * size / (1024.0 * 1024.0) / (end - start);
+}
+
+// already compressed data (images, audio) is stored and read without decompression
+void benchmark_incompressible(int size, double *writeSpeed, double *readSpeed)
+{
+	char *data = malloc(size);
+	unsigned int state = 2463534242u;
+	for (int i = 0; i < size; i++)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		data[i] = (char)state;
+	}
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	double start = get_time();
+	int compSize = zpak_write(zpak, "texture.png", data, size);
+	double end = get_time();
+	assert(compSize == size);
+	*writeSpeed = (double)size / (1024.0 * 1024.0) / (end - start);
+	char *output = malloc(size);
+	start = get_time();
+	int read = zpak_read_into(zpak, "texture.png", output, size);
+	end = get_time();
+	assert(read == size && memcmp(data, output, size) == 0);
+	*readSpeed = (double)size / (1024.0 * 1024.0) / (end - start);
+	zpak_destruct(zpak);
+	free(output);
+	free(data);
+}
+
+#ifdef BENCH_THREADS
+typedef struct {
+	zpak_t *zpak;
+	int id;
+	int reads;
+} bench_reader_t;
+
+static void* bench_read_entries(void *arg)
+{
+	bench_reader_t *reader = (bench_reader_t*)arg;
+	char path[32];
+	char output[64];
+	for (int r = 0; r < reader->reads; r++)
+	{
+		sprintf(path, "dir/file%i.txt", (r * 7919 + reader->id) % 10000);
+		zpak_handle_t handle = zpak_find(reader->zpak, path);
+		int size = zpak_handle_read_buf(reader->zpak, handle, output, sizeof(output));
+		assert(size == (int)strlen(path) + 1);
+	}
+	return NULL;
+}
+
+// returns reads per second of threads sharing single static zpak
+double benchmark_concurrent_reads(int threadCount)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY);
+	for (int i = 0; i < 10000; i++)
+	{
+		sprintf(path, "dir/file%i.txt", i);
+		zpak_write(zpak, path, path, strlen(path) + 1);
+	}
+	void *blob;
+	int blobSize = zpak_write_end(zpak, &blob);
+	zpak_destruct(zpak);
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak, blob, blobSize);
+	pthread_t threads[64];
+	bench_reader_t readers[64];
+	const int reads = 200000;
+	double start = get_time();
+	for (int t = 0; t < threadCount; t++)
+	{
+		readers[t].zpak = zpak;
+		readers[t].id = t;
+		readers[t].reads = reads;
+		pthread_create(threads + t, NULL, bench_read_entries, readers + t);
+	}
+	for (int t = 0; t < threadCount; t++)
+		pthread_join(threads[t], NULL);
+	double end = get_time();
+	zpak_destruct(zpak);
+	free(blob);
+	return (double)reads * threadCount / (end - start);
+}
+#endif
+
 int main(int arg, const char **argv) 
 {	
 	printf("benchmarks:\n"
 		"* entry search: %fs\n", benchmark_entry_search(1000000)
 	);
+	printf("* entry scan (zpak_it_next): %fs\n"
+		"* entry scan (hash column): %fs\n", 
+		benchmark_hash_column_search(1000000, 0),
+		benchmark_hash_column_search(1000000, ZPAK_F_HASH_COLUMN)
+	);
+	printf("* long path lookup (djb2): %.9fs\n"
+		"* long path lookup (word at a time): %.9fs\n", 
+		benchmark_long_path_lookup(10000, 0),
+		benchmark_long_path_lookup(10000, ZPAK_F_FAST_HASH)
+	);
+	printf("* missing entry lookup (scan): %.9fs\n"
+		"* missing entry lookup (bloom filter): %.9fs\n", 
+		benchmark_missing_lookup(100000, 0),
+		benchmark_missing_lookup(100000, ZPAK_F_BLOOM)
+	);
+	printf("* lzs decompression: %.1f MB/s\n", benchmark_decompression(4 * 1024 * 1024));
+	printf("* lzs compression (text corpus): %.1f MB/s\n"
+		"* lzs simple compression (text corpus): %.1f MB/s\n",
+		benchmark_lzs_compression(4 * 1024 * 1024, 0),
+		benchmark_lzs_compression(512 * 1024, 1)
+	);
+	printf("* 4KB range read (single stream): %.9fs\n"
+		"* 4KB range read (chunked): %.9fs\n", 
+		benchmark_range_read(4 * 1024 * 1024, 0),
+		benchmark_range_read(4 * 1024 * 1024, ZPAK_F_CHUNKED)
+	);
+	for (int level = 0; level <= 9; level++)
+	{
+		double compSpeed, ratio;
+		benchmark_compression_level(4 * 1024 * 1024, level, &compSpeed, &ratio);
+		printf("* compression level %i: %.1f MB/s, ratio %.4f\n", level, compSpeed, ratio);
+	}
+	double writeSpeed, readSpeed;
+	benchmark_incompressible(16 * 1024 * 1024, &writeSpeed, &readSpeed);
+	printf("* incompressible entry: write %.1f MB/s, read %.1f MB/s\n", writeSpeed, readSpeed);
+	int threadCounts[] = { 1, 2, 4, 0 };
+	for (int i = 0; i < 4; i++)
+		printf("* batch write, %i threads (0 = all cores): %.1f MB/s\n", threadCounts[i], benchmark_batch_write(10000, 4096, threadCounts[i]));
+	for (int i = 0; i < 4; i++)
+	{
+		double compSpeed, decompSpeed;
+		benchmark_parallel_chunked(64 * 1024 * 1024, threadCounts[i], &compSpeed, &decompSpeed);
+		printf("* chunked entry, %i threads (0 = all cores): compression %.1f MB/s, decompression %.1f MB/s\n", 
+			threadCounts[i], compSpeed, decompSpeed);
+	}
+#ifdef BENCH_THREADS
+	int readerCounts[] = { 1, 2, 4, 8 };
+	for (int i = 0; i < 4; i++)
+		printf("* concurrent reads, %i threads: %.0f reads/s\n", readerCounts[i], benchmark_concurrent_reads(readerCounts[i]));
+#endif
 	return 0;
 }
@@ -1,8 +1,13 @@
 #include "minunit.h"
 #include "zpak.h"
+#include "lzs/lzs.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(ZPAK_THREADS) && !defined(_WIN32)
+	#include <pthread.h>
+	#define TEST_THREADS
+#endif
 
 // fixme, try not to rely on internal structures
 #define ZPAK_HEADER_SIZE 6
@@ -213,6 +218,1128 @@ MU_TEST(it_should_write_data_in_user_buffer)
 	zpak_destruct(zpak);
 }
 
+MU_TEST(it_should_write_directory_and_read_entries_through_it)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY);
+	for (int i = 0; i < 100; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		zpak_write(zpak, path, data, dataLength);
+	}
+	zpak_write(zpak, "more", data2, data2Length);
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	mu_assert(((char*)output)[4] == 2, "should write zpak version 2");
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, output, totalSize);
+	mu_assert(result == 0, zpak_get_last_error(zpak2));
+	void *outdata;
+	int readSize = zpak_read(zpak2, "scripts/file42.txt", &outdata);
+	mu_assert_int_eq((int)dataLength, readSize);
+	mu_assert(strcmp(data, outdata) == 0, "should unpack entry data");
+	free(outdata);
+	readSize = zpak_read(zpak2, "more", &outdata);
+	mu_assert_int_eq((int)data2Length, readSize);
+	mu_assert(strcmp(data2, outdata) == 0, "should unpack entry data");
+	free(outdata);
+	mu_assert(zpak_read(zpak2, "scripts/missing.txt", &outdata) == 0, "should not find missing entry");
+	zpak_it_t *it = zpak_it_construct(zpak2);
+	int count = 0;
+	while (zpak_it_next(it))
+		count++;
+	mu_assert_int_eq(101, count);
+	zpak_it_destruct(it);
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(output);
+}
+
+MU_TEST(it_should_rebuild_directory_after_writing_into_loaded_pak)
+{
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_DIRECTORY);
+	zpak_write(zpak, "test", data, dataLength);
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_RW);
+	int result = zpak_load_data(zpak2, output, totalSize);
+	mu_assert(result == 0, zpak_get_last_error(zpak2));
+	zpak_write(zpak2, "more", data2, data2Length);
+	void *outdata;
+	int readSize = zpak_read(zpak2, "more", &outdata);
+	mu_assert_int_eq((int)data2Length, readSize);
+	free(outdata);
+	void *output2;
+	int totalSize2 = zpak_write_end(zpak2, &output2);
+	zpak_t *zpak3 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	result = zpak_load_data(zpak3, output2, totalSize2);
+	mu_assert(result == 0, zpak_get_last_error(zpak3));
+	readSize = zpak_read(zpak3, "test", &outdata);
+	mu_assert_int_eq((int)dataLength, readSize);
+	free(outdata);
+	readSize = zpak_read(zpak3, "more", &outdata);
+	mu_assert_int_eq((int)data2Length, readSize);
+	mu_assert(strcmp(data2, outdata) == 0, "should unpack entry data");
+	free(outdata);
+	zpak_destruct(zpak3);
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(output2);
+	free(output);
+}
+
+MU_TEST(it_should_build_lazy_index_for_v1_pak)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	for (int i = 0; i < 100; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		zpak_write(zpak, path, data, dataLength);
+	}
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_set_lazy_index(zpak2, 1);
+	int result = zpak_load_static_data(zpak2, output, totalSize);
+	mu_assert(result == 0, zpak_get_last_error(zpak2));
+	zpak_stats_t stats;
+	zpak_get_stats(zpak2, &stats);
+	mu_assert_int_eq(0, stats.indexMemory);
+	void *outdata;
+	int readSize = zpak_read(zpak2, "scripts/file99.txt", &outdata);
+	mu_assert_int_eq((int)dataLength, readSize);
+	mu_assert(strcmp(data, outdata) == 0, "should unpack entry data");
+	free(outdata);
+	mu_assert(zpak_read(zpak2, "scripts/missing.txt", &outdata) == 0, "should not find missing entry");
+	zpak_get_stats(zpak2, &stats);
+	mu_assert(stats.indexMemory > 0, "should report index memory");
+	zpak_set_lazy_index(zpak2, 0);
+	zpak_get_stats(zpak2, &stats);
+	mu_assert_int_eq(0, stats.indexMemory);
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(output);
+}
+
+MU_TEST(it_should_read_entries_through_perfect_hash)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_PERFECT_HASH);
+	for (int i = 0; i < 1000; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		zpak_write(zpak, path, path, strlen(path) + 1);
+	}
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	mu_assert(totalSize > 0, zpak_get_last_error(zpak));
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, output, totalSize);
+	mu_assert(result == 0, zpak_get_last_error(zpak2));
+	for (int i = 0; i < 1000; i++)
+	{
+		void *outdata;
+		sprintf(path, "scripts/file%i.txt", i);
+		int readSize = zpak_read(zpak2, path, &outdata);
+		mu_assert_int_eq((int)strlen(path) + 1, readSize);
+		mu_assert(strcmp(path, outdata) == 0, "should unpack entry data");
+		free(outdata);
+	}
+	void *outdata;
+	mu_assert(zpak_read(zpak2, "scripts/missing.txt", &outdata) == 0, "should not find missing entry");
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(output);
+}
+
+MU_TEST(it_should_read_entries_through_hash_column)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_HASH_COLUMN);
+	for (int i = 0; i < 103; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		zpak_write(zpak, path, path, strlen(path) + 1);
+	}
+	zpak_write(zpak, "scripts/file7.txt", data, dataLength);
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	mu_assert(totalSize > 0, zpak_get_last_error(zpak));
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, output, totalSize);
+	mu_assert(result == 0, zpak_get_last_error(zpak2));
+	for (int i = 0; i < 103; i++)
+	{
+		void *outdata;
+		sprintf(path, "scripts/file%i.txt", i);
+		int readSize = zpak_read(zpak2, path, &outdata);
+		mu_assert_int_eq((int)strlen(path) + 1, readSize);
+		mu_assert(strcmp(path, outdata) == 0, "should read the first of duplicate entries");
+		free(outdata);
+	}
+	void *outdata;
+	mu_assert(zpak_read(zpak2, "scripts/missing.txt", &outdata) == 0, "should not find missing entry");
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(output);
+}
+
+MU_TEST(it_should_read_many_entries_at_once)
+{
+	int flags[] = { ZPAK_F_RW, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY };
+	for (int f = 0; f < 2; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_write(zpak, "test", data, dataLength);
+		zpak_write(zpak, "more", data2, data2Length);
+		zpak_write(zpak, "dup", data, dataLength);
+		zpak_write(zpak, "dup", data2, data2Length);
+		void *output;
+		int totalSize = zpak_write_end(zpak, &output);
+		zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		zpak_load_static_data(zpak2, output, totalSize);
+		const char *names[] = { "more", "missing", "test", "", "dup", "more" };
+		zpak_read_result_t results[6];
+		void *arena;
+		int found = zpak_read_many(zpak2, names, 6, results, &arena);
+		mu_assert_int_eq(4, found);
+		mu_assert_int_eq(ZPAK_S_OK, results[0].status);
+		mu_assert_int_eq(ZPAK_S_NOT_FOUND, results[1].status);
+		mu_assert_int_eq(ZPAK_S_INVALID_NAME, results[3].status);
+		mu_assert_int_eq((int)data2Length, results[0].size);
+		mu_assert(strcmp(data2, results[0].data) == 0, "should unpack entry data");
+		mu_assert(strcmp(data, results[2].data) == 0, "should unpack entry data");
+		mu_assert(strcmp(data, results[4].data) == 0, "should read the first of duplicate entries");
+		mu_assert(strcmp(data2, results[5].data) == 0, "should unpack repeated entry data");
+		free(arena);
+		zpak_destruct(zpak2);
+		zpak_destruct(zpak);
+		free(output);
+	}
+}
+
+MU_TEST(it_should_list_entries_by_prefix)
+{
+	int flags[] = { ZPAK_F_RW, ZPAK_F_RW | ZPAK_F_NAME_INDEX };
+	for (int f = 0; f < 2; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_write(zpak, "textures/b.png", data, dataLength);
+		zpak_write(zpak, "sounds/a.wav", data2, data2Length);
+		zpak_write(zpak, "textures/a.png", data2, data2Length);
+		zpak_write(zpak, "textures", data, dataLength);
+		void *output;
+		int totalSize = zpak_write_end(zpak, &output);
+		zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		zpak_load_static_data(zpak2, output, totalSize);
+		zpak_it_t *it = zpak_it_construct(zpak2);
+		mu_assert_int_eq(2, zpak_list_prefix(zpak2, "textures/", it));
+		int count = 0, seenA = 0;
+		while (zpak_it_next(it))
+		{
+			const char *name = zpak_it_get_entry_name(it);
+			mu_assert(strncmp(name, "textures/", 9) == 0, "should list only prefixed entries");
+			if (strcmp(name, "textures/a.png") == 0)
+			{
+				seenA = 1;
+				mu_assert_int_eq((int)data2Length, zpak_it_get_entry_size(it));
+				char *buf;
+				zpak_it_read(it, (void**)&buf);
+				mu_assert(strcmp(data2, buf) == 0, "should read listed entry");
+				free(buf);
+			}
+			count++;
+		}
+		mu_assert_int_eq(2, count);
+		mu_assert_int_eq(1, seenA);
+		mu_assert_int_eq(4, zpak_list_prefix(zpak2, "", it));
+		mu_assert_int_eq(0, zpak_list_prefix(zpak2, "music/", it));
+		mu_assert_int_eq(0, zpak_it_next(it));
+		zpak_it_destruct(it);
+		zpak_destruct(zpak2);
+		zpak_destruct(zpak);
+		free(output);
+	}
+}
+
+MU_TEST(it_should_read_entries_through_handles)
+{
+	int flags[] = { ZPAK_F_RW | ZPAK_F_LZS, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY };
+	for (int f = 0; f < 2; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_write(zpak, "test", data, dataLength);
+		zpak_write(zpak, "more", data2, data2Length);
+		void *output;
+		int totalSize = zpak_write_end(zpak, &output);
+		zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ | ZPAK_F_LZS);
+		zpak_load_static_data(zpak2, output, totalSize);
+		mu_assert_int_eq(0, zpak_find(zpak2, "missing"));
+		mu_assert_int_eq(0, zpak_find(zpak2, ""));
+		zpak_handle_t handle = zpak_find(zpak2, "more");
+		mu_assert(handle != 0, "should resolve entry handle");
+		mu_assert_int_eq((int)data2Length, zpak_handle_size(zpak2, handle));
+		char *buf;
+		mu_assert_int_eq((int)data2Length, zpak_handle_read(zpak2, handle, (void**)&buf));
+		mu_assert(strcmp(data2, buf) == 0, "should read entry through handle");
+		free(buf);
+		char buf2[64];
+		mu_assert_int_eq((int)data2Length, zpak_handle_read_buf(zpak2, handle, buf2, sizeof(buf2)));
+		mu_assert(strcmp(data2, buf2) == 0, "should read entry into user buffer");
+		mu_assert_int_eq(-1, zpak_handle_size(zpak2, 0));
+		mu_assert_int_eq(-1, zpak_handle_read(zpak2, (zpak_handle_t)totalSize, (void**)&buf));
+		zpak_destruct(zpak2);
+		zpak_destruct(zpak);
+		free(output);
+	}
+}
+
+MU_TEST(it_should_read_entries_hashed_word_at_a_time)
+{
+	char path[64];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_FAST_HASH);
+	// cover every tail length of the word at a time hash
+	for (int i = 1; i < 48; i++)
+	{
+		memset(path, 'a' + i % 26, i);
+		path[i] = 0;
+		zpak_write(zpak, path, path, i + 1);
+	}
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	mu_assert(totalSize > 0, zpak_get_last_error(zpak));
+	mu_assert_int_eq(3, ((const char*)output)[4]);
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	int result = zpak_load_static_data(zpak2, output, totalSize);
+	mu_assert(result == 0, zpak_get_last_error(zpak2));
+	for (int i = 1; i < 48; i++)
+	{
+		void *outdata;
+		memset(path, 'a' + i % 26, i);
+		path[i] = 0;
+		int readSize = zpak_read(zpak2, path, &outdata);
+		mu_assert_int_eq(i + 1, readSize);
+		mu_assert(strcmp(path, outdata) == 0, "should unpack entry data");
+		free(outdata);
+	}
+	void *outdata;
+	mu_assert(zpak_read(zpak2, "missing", &outdata) == 0, "should not find missing entry");
+	zpak_destruct(zpak2);
+	zpak_destruct(zpak);
+	free(output);
+}
+
+MU_TEST(it_should_verify_entry_names_on_hash_collision)
+{
+	// "aa" and "b@" have equal djb2 hashes
+	int flags[] = { ZPAK_F_RW, ZPAK_F_RW | ZPAK_F_DIRECTORY, ZPAK_F_RW | ZPAK_F_PERFECT_HASH, ZPAK_F_RW | ZPAK_F_HASH_COLUMN };
+	for (int f = 0; f < 4; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_write(zpak, "aa", data, dataLength);
+		zpak_write(zpak, "b@", data2, data2Length);
+		void *output;
+		int totalSize = zpak_write_end(zpak, &output);
+		zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		zpak_load_static_data(zpak2, output, totalSize);
+		char *outdata;
+		mu_assert_int_eq((int)dataLength, zpak_read(zpak2, "aa", (void**)&outdata));
+		mu_assert(strcmp(data, outdata) == 0, "should read entry with colliding hash");
+		free(outdata);
+		mu_assert_int_eq((int)data2Length, zpak_read(zpak2, "b@", (void**)&outdata));
+		mu_assert(strcmp(data2, outdata) == 0, "should read entry with colliding hash");
+		free(outdata);
+		mu_assert_int_eq(0, zpak_read(zpak2, "c\x1f", (void**)&outdata));
+		const char *names[] = { "b@", "aa" };
+		zpak_read_result_t results[2];
+		void *arena;
+		mu_assert_int_eq(2, zpak_read_many(zpak2, names, 2, results, &arena));
+		mu_assert(strcmp(data2, results[0].data) == 0, "should read entry with colliding hash");
+		mu_assert(strcmp(data, results[1].data) == 0, "should read entry with colliding hash");
+		free(arena);
+		zpak_destruct(zpak2);
+		zpak_destruct(zpak);
+		free(output);
+	}
+}
+
+MU_TEST(it_should_cache_lookup_results)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW);
+	for (int i = 0; i < 100; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		zpak_write(zpak, path, path, strlen(path) + 1);
+	}
+	zpak_write(zpak, "aa", data, dataLength);
+	mu_assert_int_eq(0, zpak_set_lookup_cache(zpak, 8));
+	zpak_stats_t stats;
+	for (int round = 0; round < 2; round++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			sprintf(path, "scripts/file%i.txt", i);
+			mu_assert(zpak_find(zpak, path) != 0, "should find entry");
+		}
+		mu_assert_int_eq(0, zpak_find(zpak, "scripts/missing.txt"));
+	}
+	zpak_get_stats(zpak, &stats);
+	mu_assert_int_eq(5, stats.cacheHits);
+	mu_assert_int_eq(5, stats.cacheMisses);
+	// "b@" collides with cached "aa"
+	mu_assert(zpak_find(zpak, "aa") != 0, "should find entry");
+	mu_assert_int_eq(0, zpak_find(zpak, "b@"));
+	mu_assert(zpak_find(zpak, "aa") != 0, "should find entry");
+	// writes invalidate cached results
+	zpak_write(zpak, "scripts/missing.txt", data, dataLength);
+	zpak_write(zpak, "b@", data2, data2Length);
+	char *outdata;
+	mu_assert_int_eq((int)dataLength, zpak_read(zpak, "scripts/missing.txt", (void**)&outdata));
+	free(outdata);
+	mu_assert_int_eq((int)data2Length, zpak_read(zpak, "b@", (void**)&outdata));
+	mu_assert(strcmp(data2, outdata) == 0, "should read entry with colliding hash");
+	free(outdata);
+	// evicted entries are still found
+	for (int i = 0; i < 100; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		mu_assert(zpak_find(zpak, path) != 0, "should find entry");
+	}
+	mu_assert_int_eq(0, zpak_set_lookup_cache(zpak, 0));
+	mu_assert(zpak_find(zpak, "scripts/file1.txt") != 0, "should find entry");
+	zpak_destruct(zpak);
+}
+
+MU_TEST(it_should_reject_missing_entries_with_bloom_filter)
+{
+	char path[32];
+	int bits[] = { 10, 4 };
+	int rejects[2];
+	for (int b = 0; b < 2; b++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_BLOOM);
+		mu_assert_int_eq(0, zpak_set_bloom_bits(zpak, bits[b]));
+		for (int i = 0; i < 1000; i++)
+		{
+			sprintf(path, "scripts/file%i.txt", i);
+			zpak_write(zpak, path, path, strlen(path) + 1);
+		}
+		void *output;
+		int totalSize = zpak_write_end(zpak, &output);
+		mu_assert(totalSize > 0, zpak_get_last_error(zpak));
+		zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		int result = zpak_load_static_data(zpak2, output, totalSize);
+		mu_assert(result == 0, zpak_get_last_error(zpak2));
+		for (int i = 0; i < 1000; i++)
+		{
+			sprintf(path, "scripts/file%i.txt", i);
+			mu_assert(zpak_find(zpak2, path) != 0, "should find every written entry");
+		}
+		for (int i = 0; i < 10000; i++)
+		{
+			sprintf(path, "modules/file%i.txt", i);
+			mu_assert_int_eq(0, zpak_find(zpak2, path));
+		}
+		zpak_stats_t stats;
+		zpak_get_stats(zpak2, &stats);
+		rejects[b] = stats.bloomRejects;
+		zpak_destruct(zpak2);
+		// misses are looked up once more through the lookup cache, rejects are counted once
+		zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		zpak_load_static_data(zpak2, output, totalSize);
+		zpak_set_lookup_cache(zpak2, 64);
+		for (int i = 0; i < 10000; i++)
+		{
+			sprintf(path, "modules/file%i.txt", i);
+			mu_assert_int_eq(0, zpak_find(zpak2, path));
+		}
+		zpak_get_stats(zpak2, &stats);
+		mu_assert_int_eq(rejects[b], stats.bloomRejects);
+		zpak_destruct(zpak2);
+		zpak_destruct(zpak);
+		free(output);
+	}
+	mu_assert(rejects[0] > 9700, "should reject most missing names with 10 bits per entry");
+	mu_assert(rejects[1] < rejects[0], "should reject fewer missing names with smaller filter");
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW);
+	mu_assert_int_eq(-1, zpak_set_bloom_bits(zpak, 0));
+	zpak_destruct(zpak);
+}
+
+MU_TEST(it_should_verify_pak)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY | ZPAK_F_PERFECT_HASH | 
+		ZPAK_F_NAME_INDEX | ZPAK_F_HASH_COLUMN);
+	for (int i = 0; i < 100; i++)
+	{
+		sprintf(path, "scripts/file%i.txt", i);
+		zpak_write(zpak, path, path, strlen(path) + 1);
+	}
+	// short entries do not shrink and are stored, compressed entry repeats its data
+	const char text[] = "somedata somedata somedata";
+	zpak_write(zpak, "test", text, sizeof(text));
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	mu_assert(totalSize > 0, zpak_get_last_error(zpak));
+	zpak_t *zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak2, output, totalSize);
+	mu_assert(zpak_verify(zpak2) == 0, zpak_get_last_error(zpak2));
+	char *outdata;
+	mu_assert_int_eq((int)sizeof(text), zpak_read(zpak2, "test", (void**)&outdata));
+	mu_assert(strcmp(text, outdata) == 0, "should read verified entry");
+	free(outdata);
+	zpak_destruct(zpak2);
+	// corrupt match offset in compressed data of the last entry, its data follows the name
+	char *corrupted = malloc(totalSize);
+	memcpy(corrupted, output, totalSize);
+	zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak2, corrupted, totalSize);
+	zpak_handle_t handle = zpak_find(zpak2, "test");
+	unsigned char *entryData = (unsigned char*)corrupted + handle + ZPAK_ENTRY_HEADER_SIZE + 5;
+	entryData[0] = 0xC0; // short offset token, offset is outside of the history
+	mu_assert_int_eq(-1, zpak_verify(zpak2));
+	zpak_destruct(zpak2);
+	// corrupt entry name
+	memcpy(corrupted, output, totalSize);
+	corrupted[handle + ZPAK_ENTRY_HEADER_SIZE] = 'b';
+	zpak2 = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak2, corrupted, totalSize);
+	mu_assert_int_eq(-1, zpak_verify(zpak2));
+	zpak_destruct(zpak2);
+	free(corrupted);
+	zpak_destruct(zpak);
+	free(output);
+}
+
+MU_TEST(it_should_stream_entry_in_chunks)
+{
+	const int size = 100000;
+	char *input = malloc(size);
+	for (int i = 0; i < size; i++)
+		input[i] = (i % 7) ? "stream data "[i % 12] : (char)(i * 31);
+	char chunk[333];
+	unsigned int flags[] = { ZPAK_F_RW, ZPAK_F_RW | ZPAK_F_LZS };
+	for (int f = 0; f < 2; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_write(zpak, "test", data, dataLength);
+		zpak_write(zpak, "stream", input, size);
+		zpak_entry_t *reader = zpak_entry_open(zpak, "stream");
+		mu_assert(reader, "should open entry reader");
+		int total = 0, res;
+		while ((res = zpak_entry_read(reader, chunk, sizeof(chunk))) > 0)
+		{
+			mu_assert(memcmp(input + total, chunk, res) == 0, "should stream entry data");
+			total += res;
+		}
+		mu_assert_int_eq(0, res);
+		mu_assert_int_eq(size, total);
+		zpak_entry_close(reader);
+		mu_assert(zpak_entry_open(zpak, "missing") == NULL, "should not open missing entry");
+		zpak_destruct(zpak);
+	}
+	free(input);
+}
+
+MU_TEST(it_should_read_ranges_of_chunked_entries)
+{
+	const int size = 100000;
+	char *input = malloc(size);
+	for (int i = 0; i < size; i++)
+		input[i] = (i % 5) ? "chunked data "[i % 13] : (char)(i * 17);
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED | ZPAK_F_DIRECTORY);
+	mu_assert_int_eq(0, zpak_set_chunk_size(zpak, 4096));
+	zpak_write(zpak, "test", data, dataLength);
+	zpak_write(zpak, "chunked", input, size);
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	mu_assert(totalSize > 0, zpak_get_last_error(zpak));
+	zpak_destruct(zpak);
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	mu_assert(zpak_load_static_data(zpak, output, totalSize) == 0, zpak_get_last_error(zpak));
+	for (int pass = 0; pass < 2; pass++)
+	{
+		char *outdata;
+		mu_assert_int_eq(size, zpak_read(zpak, "chunked", (void**)&outdata));
+		mu_assert(memcmp(input, outdata, size) == 0, "should read whole chunked entry");
+		free(outdata);
+		mu_assert_int_eq((int)dataLength, zpak_read(zpak, "test", (void**)&outdata));
+		mu_assert(strcmp(data, outdata) == 0, "should read small entry");
+		free(outdata);
+		char range[10000];
+		unsigned int ranges[][2] = { { 0, 10 }, { 100, 3000 }, { 4000, 200 }, { 4096, 4096 }, { 1234, 10000 }, { size - 5, 5 } };
+		for (int r = 0; r < 6; r++)
+		{
+			memset(range, 0, sizeof(range));
+			mu_assert_int_eq((int)ranges[r][1], zpak_read_range(zpak, "chunked", ranges[r][0], ranges[r][1], range));
+			mu_assert(memcmp(input + ranges[r][0], range, ranges[r][1]) == 0, "should read entry range");
+		}
+		mu_assert_int_eq(10, zpak_read_range(zpak, "chunked", size - 10, 100, range));
+		mu_assert(memcmp(input + size - 10, range, 10) == 0, "should clamp range to the entry end");
+		mu_assert_int_eq(4, zpak_read_range(zpak, "test", 2, 4, range));
+		mu_assert(memcmp(data + 2, range, 4) == 0, "should read range of single stream entry");
+		mu_assert_int_eq(-1, zpak_read_range(zpak, "chunked", size + 1, 1, range));
+		mu_assert_int_eq(0, zpak_read_range(zpak, "missing", 0, 1, range));
+		zpak_entry_t *reader = zpak_entry_open(zpak, "chunked");
+		int total = 0, res;
+		while ((res = zpak_entry_read(reader, range, 777)) > 0)
+		{
+			mu_assert(memcmp(input + total, range, res) == 0, "should stream chunked entry");
+			total += res;
+		}
+		mu_assert_int_eq(size, total);
+		zpak_entry_close(reader);
+		mu_assert(zpak_verify(zpak) == 0, zpak_get_last_error(zpak));
+	}
+	zpak_destruct(zpak);
+	// corrupt second block offset of the seek table, which follows the chunk header
+	char *corrupted = malloc(totalSize);
+	memcpy(corrupted, output, totalSize);
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak, corrupted, totalSize);
+	zpak_handle_t handle = zpak_find(zpak, "chunked");
+	memset(corrupted + handle + ZPAK_ENTRY_HEADER_SIZE + sizeof("chunked") + 12, 0xFF, 4);
+	char *outdata = (char*)corrupted;
+	char head[10];
+	mu_assert_int_eq(-1, zpak_read(zpak, "chunked", (void**)&outdata));
+	mu_assert(outdata == NULL, "should not return buffer of failed read");
+	const char *names[] = { "chunked", "test" };
+	zpak_read_result_t results[2];
+	void *arena;
+	mu_assert_int_eq(1, zpak_read_many(zpak, names, 2, results, &arena));
+	mu_assert_int_eq(ZPAK_S_CORRUPTED, results[0].status);
+	mu_assert(results[0].data == NULL, "should not return data of corrupted entry");
+	mu_assert_int_eq(ZPAK_S_OK, results[1].status);
+	mu_assert(strcmp(data, results[1].data) == 0, "should read entries after corrupted one");
+	free(arena);
+	// block count whose seek table does not fit into the entry data
+	memcpy(corrupted, output, totalSize);
+	memset(corrupted + handle + ZPAK_ENTRY_HEADER_SIZE + sizeof("chunked") + 4, 0xFF, 4);
+	mu_assert_int_eq(-1, zpak_read_range(zpak, "chunked", 0, 10, head));
+	mu_assert(zpak_entry_open(zpak, "chunked") == NULL, "should not open entry with malformed seek table");
+	zpak_destruct(zpak);
+	free(corrupted);
+	free(output);
+	// chunked archive keeps plain lzs type until a chunked entry is written
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED);
+	zpak_write(zpak, "test", input, 1000);
+	totalSize = zpak_write_end(zpak, &output);
+	zpak_destruct(zpak);
+	mu_assert_int_eq(1, ((unsigned char*)output)[5]);
+	free(output);
+	// chunked entry appended to loaded lzs archive raises its compression type
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_write(zpak, "test", input, 1000);
+	totalSize = zpak_write_end(zpak, &output);
+	zpak_destruct(zpak);
+	mu_assert_int_eq(1, ((unsigned char*)output)[5]);
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED);
+	mu_assert_int_eq(0, zpak_load_data(zpak, output, totalSize));
+	free(output);
+	zpak_write(zpak, "chunked", input, size);
+	totalSize = zpak_write_end(zpak, &output);
+	zpak_destruct(zpak);
+	mu_assert_int_eq(2, ((unsigned char*)output)[5]);
+	free(output);
+	free(input);
+}
+
+MU_TEST(it_should_compress_chunked_entries_in_parallel)
+{
+	const int size = 1000000;
+	char *input = malloc(size);
+	for (int i = 0; i < size; i++)
+		input[i] = (i % 3) ? "parallel data "[i % 14] : (char)('a' + (i / 7) % 26);
+	void *outputs[2];
+	int totalSizes[2];
+	int threads[] = { 1, 4 };
+	for (int t = 0; t < 2; t++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED);
+		zpak_set_chunk_size(zpak, 10000);
+		mu_assert_int_eq(0, zpak_set_threads(zpak, threads[t]));
+		zpak_write(zpak, "chunked", input, size);
+		totalSizes[t] = zpak_write_end(zpak, &outputs[t]);
+		mu_assert(totalSizes[t] > 0, zpak_get_last_error(zpak));
+		zpak_destruct(zpak);
+	}
+	mu_assert_int_eq(totalSizes[0], totalSizes[1]);
+	mu_assert(memcmp(outputs[0], outputs[1], totalSizes[0]) == 0, "should write the same blob with any thread count");
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak, outputs[1], totalSizes[1]);
+	zpak_set_threads(zpak, 0);
+	char *outdata;
+	mu_assert_int_eq(size, zpak_read(zpak, "chunked", (void**)&outdata));
+	mu_assert(memcmp(input, outdata, size) == 0, "should decompress blocks in parallel");
+	mu_assert_int_eq(500000, zpak_read_range(zpak, "chunked", 12345, 500000, outdata));
+	mu_assert(memcmp(input + 12345, outdata, 500000) == 0, "should read range of blocks in parallel");
+	free(outdata);
+	// blocks of the corrupted seek table fail on several workers at once
+	unsigned char *table = (unsigned char*)outputs[1] + zpak_find(zpak, "chunked") + ZPAK_ENTRY_HEADER_SIZE + sizeof("chunked") + 8;
+	for (int b = 1; b < 100; b += 2)
+		memset(table + b * 4, 0, 4);
+	mu_assert_int_eq(-1, zpak_read(zpak, "chunked", (void**)&outdata));
+	zpak_destruct(zpak);
+	free(outputs[0]);
+	free(outputs[1]);
+	free(input);
+}
+
+MU_TEST(it_should_share_cached_entries_within_budget)
+{
+	char path[32];
+	char payload[1000];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY);
+	for (int i = 0; i < 10; i++)
+	{
+		sprintf(path, "entry%i", i);
+		memset(payload, 'a' + i, sizeof(payload));
+		zpak_write(zpak, path, payload, sizeof(payload));
+	}
+	zpak_write(zpak, "large", data, dataLength);
+	mu_assert_int_eq(0, zpak_set_entry_cache(zpak, 3500));
+	const void *first, *second;
+	mu_assert_int_eq(1000, zpak_read_cached(zpak, "entry0", &first));
+	mu_assert_int_eq(1000, zpak_read_cached(zpak, "entry0", &second));
+	mu_assert(first == second, "should share cached entry data");
+	mu_assert(((const char*)first)[999] == 'a', "should decompress cached entry");
+	zpak_stats_t stats;
+	zpak_get_stats(zpak, &stats);
+	mu_assert_int_eq(1, stats.entryCacheHits);
+	mu_assert_int_eq(1, stats.entryCacheMisses);
+	mu_assert_int_eq(1000, stats.entryCacheMemory);
+	// entry0 stays pinned, while other entries cycle through the remaining budget
+	for (int i = 1; i < 10; i++)
+	{
+		const void *view;
+		sprintf(path, "entry%i", i);
+		mu_assert_int_eq(1000, zpak_read_cached(zpak, path, &view));
+		mu_assert(((const char*)view)[0] == 'a' + i, "should read cached entry");
+		zpak_release_cached(zpak, view);
+		zpak_get_stats(zpak, &stats);
+		mu_assert(stats.entryCacheMemory <= 3500, "should keep cache within budget");
+	}
+	zpak_get_stats(zpak, &stats);
+	mu_assert(stats.entryCacheEvictions >= 7, "should evict released entries");
+	mu_assert_int_eq(1000, zpak_read_cached(zpak, "entry0", &second));
+	mu_assert(first == second, "should not evict entry with outstanding views");
+	zpak_release_cached(zpak, second);
+	zpak_release_cached(zpak, first);
+	zpak_release_cached(zpak, first);
+	mu_assert_int_eq(0, zpak_read_cached(zpak, "missing", &first));
+	mu_assert(first == NULL, "should not return data of missing entry");
+	// cache is dropped on write, outstanding views stay valid
+	mu_assert_int_eq(1000, zpak_read_cached(zpak, "entry9", &first));
+	zpak_write(zpak, "new", data, dataLength);
+	zpak_get_stats(zpak, &stats);
+	mu_assert_int_eq(0, stats.entryCacheMemory);
+	mu_assert(((const char*)first)[0] == 'j', "should keep outstanding view alive");
+	zpak_release_cached(zpak, first);
+	zpak_destruct(zpak);
+}
+
+MU_TEST(it_should_read_stored_entries_without_copy)
+{
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW);
+	zpak_write(zpak, "test", data, dataLength);
+	zpak_write(zpak, "test2", data2, sizeof(data2));
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	zpak_destruct(zpak);
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak, output, totalSize);
+	const void *view;
+	mu_assert_int_eq((int)sizeof(data2), zpak_read_view(zpak, "test2", &view));
+	mu_assert(strcmp(data2, view) == 0, "should view stored entry");
+	mu_assert((const char*)view > (const char*)output && (const char*)view < (const char*)output + totalSize, 
+		"should point into the blob");
+	zpak_release_view(zpak, view);
+	mu_assert_int_eq(0, zpak_read_view(zpak, "missing", &view));
+	zpak_destruct(zpak);
+	free(output);
+	// writes, which may move the blob, wait for stored views
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_RW);
+	zpak_write(zpak, "test", data, dataLength);
+	mu_assert_int_eq((int)dataLength, zpak_read_view(zpak, "test", &view));
+	char *large = calloc(1, 1024 * 1024);
+	mu_assert_int_eq(-1, zpak_write(zpak, "large", large, 1024 * 1024));
+	zpak_release_view(zpak, view);
+	mu_assert_int_eq(1024 * 1024, zpak_write(zpak, "large", large, 1024 * 1024));
+	free(large);
+	zpak_destruct(zpak);
+	// compressed entries are decompressed, entry is looked up once
+	const char text[] = "somedata somedata somedata";
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_write(zpak, "test", text, sizeof(text));
+	zpak_set_lookup_cache(zpak, 16);
+	mu_assert_int_eq((int)sizeof(text), zpak_read_view(zpak, "test", &view));
+	mu_assert(strcmp(text, view) == 0, "should view compressed entry");
+	zpak_release_view(zpak, view);
+	zpak_stats_t stats;
+	zpak_get_stats(zpak, &stats);
+	mu_assert_int_eq(1, stats.cacheHits + stats.cacheMisses);
+	zpak_destruct(zpak);
+}
+
+#ifdef TEST_THREADS
+typedef struct {
+	zpak_t *zpak;
+	int id;
+	int failures;
+} reader_args_t;
+
+// minunit is not thread-safe, failures are counted and asserted by the main thread
+static void* read_entries_concurrently(void *arg)
+{
+	reader_args_t *args = (reader_args_t*)arg;
+	char path[32];
+	for (int r = 0; r < 1000; r++)
+	{
+		sprintf(path, "dir/file%i.txt", (r * 7 + args->id) % 100);
+		char *outdata;
+		int size = zpak_read(args->zpak, path, (void**)&outdata);
+		if (size != (int)strlen(path) + 1 || strcmp(path, outdata) != 0)
+			args->failures++;
+		if (size > 0)
+			free(outdata);
+		const void *view;
+		size = zpak_read_cached(args->zpak, path, &view);
+		if (size != (int)strlen(path) + 1 || strcmp(path, view) != 0)
+			args->failures++;
+		zpak_release_cached(args->zpak, view);
+		if (zpak_read(args->zpak, "dir/missing.txt", (void**)&outdata) != 0)
+			args->failures++;
+		if (zpak_read(args->zpak, "", (void**)&outdata) != -1 || !zpak_get_last_error(args->zpak))
+			args->failures++;
+	}
+	return NULL;
+}
+
+MU_TEST(it_should_read_from_multiple_threads)
+{
+	char path[32];
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_BLOOM);
+	for (int i = 0; i < 100; i++)
+	{
+		sprintf(path, "dir/file%i.txt", i);
+		zpak_write(zpak, path, path, strlen(path) + 1);
+	}
+	void *output;
+	int totalSize = zpak_write_end(zpak, &output);
+	zpak_destruct(zpak);
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+	zpak_load_static_data(zpak, output, totalSize);
+	zpak_set_lazy_index(zpak, 1);
+	zpak_set_lookup_cache(zpak, 32);
+	zpak_set_entry_cache(zpak, 1000);
+	pthread_t threads[8];
+	reader_args_t args[8];
+	for (int t = 0; t < 8; t++)
+	{
+		args[t].zpak = zpak;
+		args[t].id = t;
+		args[t].failures = 0;
+		mu_assert_int_eq(0, pthread_create(threads + t, NULL, read_entries_concurrently, args + t));
+	}
+	for (int t = 0; t < 8; t++)
+	{
+		pthread_join(threads[t], NULL);
+		mu_assert_int_eq(0, args[t].failures);
+	}
+	mu_assert(zpak_get_last_error(zpak) == NULL, "should not see errors of other threads");
+	zpak_destruct(zpak);
+	free(output);
+}
+
+// context memory is reused, so that the next context gets the address of destructed one
+static void* reusing_alloc(void *memctx, void *ptr, int size)
+{
+	(void)ptr;
+	return size ? memctx : NULL;
+}
+
+static void* reconstruct_context(void *arg)
+{
+	zpak_t **zpak = (zpak_t**)arg;
+	void *memory = *zpak;
+	zpak_destruct(*zpak);
+	*zpak = zpak_construct(reusing_alloc, memory, ZPAK_F_RW);
+	return NULL;
+}
+
+MU_TEST(it_should_not_see_errors_of_destructed_context)
+{
+	static double memory[8192];
+	zpak_t *zpak = zpak_construct(reusing_alloc, memory, ZPAK_F_RW);
+	mu_assert_int_eq(-1, zpak_write(zpak, "", data, dataLength));
+	mu_assert(zpak_get_last_error(zpak) != NULL, "should keep error of the failed call");
+	pthread_t thread;
+	mu_assert_int_eq(0, pthread_create(&thread, NULL, reconstruct_context, &zpak));
+	pthread_join(thread, NULL);
+	mu_assert((void*)zpak == (void*)memory, "should construct context at the same address");
+	mu_assert(zpak_get_last_error(zpak) == NULL, "should not see error of destructed context");
+	zpak_destruct(zpak);
+}
+#endif
+
+static int allocCount = 0;
+
+static void* counting_alloc(void *memctx, void *ptr, int size)
+{
+	(void)memctx;
+	if (size == 0)
+	{
+		free(ptr);
+		return NULL;
+	}
+	allocCount++;
+	return realloc(ptr, size);
+}
+
+MU_TEST(it_should_read_entries_without_allocations)
+{
+	zpak_t *zpak = zpak_construct(counting_alloc, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_write(zpak, "test", data, dataLength);
+	zpak_write(zpak, "test2", data2, sizeof(data2));
+	char buffer[64];
+	allocCount = 0;
+	mu_assert_int_eq((int)sizeof(data2), zpak_read_into(zpak, "test2", buffer, sizeof(buffer)));
+	mu_assert(strcmp(data2, buffer) == 0, "should read entry into buffer");
+	mu_assert_int_eq(0, zpak_read_into(zpak, "missing", buffer, sizeof(buffer)));
+	mu_assert_int_eq(-1, zpak_read_into(zpak, "test2", buffer, 4));
+	zpak_it_storage_t storage;
+	zpak_it_t *it = zpak_it_init(&storage, zpak);
+	int count = 0;
+	while (zpak_it_next(it))
+	{
+		mu_assert_int_eq(9, zpak_it_read_buf(it, buffer, sizeof(buffer)));
+		count++;
+	}
+	mu_assert_int_eq(2, count);
+	mu_assert_int_eq(0, allocCount);
+	zpak_destruct(zpak);
+	// stored entries are truncated to the buffer size
+	zpak = zpak_construct(NULL, NULL, ZPAK_F_RW);
+	zpak_write(zpak, "test", data, dataLength);
+	memset(buffer, 'x', sizeof(buffer));
+	it = zpak_it_init(&storage, zpak);
+	zpak_it_next(it);
+	mu_assert_int_eq((int)dataLength, zpak_it_read_buf(it, buffer, 4));
+	mu_assert(memcmp(buffer, "somex", 5) == 0, "should not write past the buffer");
+	zpak_destruct(zpak);
+}
+
+MU_TEST(it_should_compress_entries_at_any_level)
+{
+	const int size = 200000;
+	char *input = malloc(size);
+	for (int i = 0; i < size; i++)
+		input[i] = (i % 7) ? "compression level "[(i / 3 + (i % 101) * (i % 13)) % 18] : (char)(i * 13);
+	int levels[] = { 0, 1, 4, 9 };
+	int totalSizes[4];
+	for (int l = 0; l < 4; l++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED);
+		zpak_set_chunk_size(zpak, 65536);
+		mu_assert_int_eq(0, zpak_set_level(zpak, levels[l]));
+		zpak_write(zpak, "single", input, 50000);
+		zpak_write(zpak, "chunked", input, size);
+		void *output;
+		totalSizes[l] = zpak_write_end(zpak, &output);
+		zpak_destruct(zpak);
+		zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		zpak_load_static_data(zpak, output, totalSizes[l]);
+		mu_assert_int_eq(0, zpak_verify(zpak));
+		char *outdata;
+		mu_assert_int_eq(50000, zpak_read(zpak, "single", (void**)&outdata));
+		mu_assert(memcmp(input, outdata, 50000) == 0, "should decompress entry of any level");
+		free(outdata);
+		mu_assert_int_eq(size, zpak_read(zpak, "chunked", (void**)&outdata));
+		mu_assert(memcmp(input, outdata, size) == 0, "should decompress chunked entry of any level");
+		free(outdata);
+		zpak_destruct(zpak);
+		free(output);
+	}
+	mu_assert(totalSizes[1] < totalSizes[0], "should compress better with hash chains");
+	mu_assert(totalSizes[2] < totalSizes[1], "should compress better with lazy matching");
+	mu_assert(totalSizes[3] < totalSizes[2], "should compress better with optimal parsing");
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	mu_assert_int_eq(-1, zpak_set_level(zpak, -1));
+	mu_assert_int_eq(-1, zpak_set_level(zpak, 10));
+	zpak_destruct(zpak);
+	free(input);
+}
+
+MU_TEST(it_should_write_batch_same_as_serial_writes)
+{
+	const int count = 40;
+	char *input = malloc(count * 5000);
+	for (int i = 0; i < count * 5000; i++)
+		input[i] = (i % 5) ? "batch of entries "[(i / 7) % 17] : (char)(i * 31);
+	char names[40][32];
+	zpak_write_entry_t entries[40];
+	for (int i = 0; i < count; i++)
+	{
+		sprintf(names[i], "dir/entry%i", i);
+		entries[i].name = names[i];
+		entries[i].data = input + i * 1000;
+		entries[i].size = 1000 + (i % 4) * 1000 * i; // some of the entries are chunked
+	}
+	int flags[] = { ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_DIRECTORY, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED, ZPAK_F_RW };
+	for (int f = 0; f < 3; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_set_chunk_size(zpak, 20000);
+		int serialSizes[40];
+		for (int i = 0; i < count; i++)
+			serialSizes[i] = zpak_write(zpak, entries[i].name, entries[i].data, entries[i].size);
+		void *expected;
+		int expectedSize = zpak_write_end(zpak, &expected);
+		zpak_destruct(zpak);
+		for (int threads = 1; threads <= 4; threads += 3)
+		{
+			zpak = zpak_construct(NULL, NULL, flags[f]);
+			zpak_set_chunk_size(zpak, 20000);
+			zpak_set_threads(zpak, threads);
+			int compSizes[40];
+			mu_assert_int_eq(count / 2, zpak_write_batch(zpak, entries, count / 2, compSizes));
+			mu_assert_int_eq(count / 2, zpak_write_batch(zpak, entries + count / 2, count / 2, compSizes + count / 2));
+			mu_assert(memcmp(serialSizes, compSizes, sizeof(compSizes)) == 0, "should return compressed sizes");
+			void *output;
+			mu_assert_int_eq(expectedSize, zpak_write_end(zpak, &output));
+			mu_assert(memcmp(expected, output, expectedSize) == 0, "should write the same blob as serial writes");
+			free(output);
+			zpak_destruct(zpak);
+		}
+		free(expected);
+	}
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_write(zpak, "first", data, dataLength);
+	entries[3].size = 0;
+	mu_assert_int_eq(-1, zpak_write_batch(zpak, entries, 4, NULL));
+	const void *view;
+	mu_assert_int_eq(0, zpak_read_view(zpak, "dir/entry0", &view));
+	zpak_destruct(zpak);
+	free(input);
+}
+
+MU_TEST(it_should_replicate_short_match_patterns)
+{
+	// periods 1-7 are replicated from a single pattern, longer ones are copied in chunks
+	const int size = 3000;
+	unsigned char input[3000];
+	unsigned char compData[3000 + 3000 / 8 + 16];
+	for (int period = 1; period <= 17; period++)
+	{
+		for (int length = 1; length <= size; length += length < 40 ? 1 : 379)
+		{
+			for (int i = 0; i < length; i++)
+				input[i] = i < 3 ? (unsigned char)(200 + i) : (unsigned char)('a' + (i - 3) % period);
+			size_t compSize = lzs_compress(compData, sizeof(compData), input, length);
+			// output buffer of exactly the decoded size, overruns are caught by sanitizers
+			unsigned char *output = malloc(length);
+			mu_assert_int_eq(length, (int)lzs_decompress(output, length, compData, compSize));
+			mu_assert(memcmp(input, output, length) == 0, "should replicate short pattern");
+			memset(output, 0, length);
+			mu_assert_int_eq(length, (int)lzs_decompress_trusted(output, length, compData, compSize));
+			mu_assert(memcmp(input, output, length) == 0, "should replicate short pattern of trusted data");
+			free(output);
+		}
+	}
+	// entry read into buffer of its size
+	zpak_t *zpak = zpak_construct(NULL, NULL, ZPAK_F_RW | ZPAK_F_LZS);
+	zpak_write(zpak, "pattern", input, size);
+	unsigned char *output = malloc(size);
+	mu_assert_int_eq(size, zpak_read_into(zpak, "pattern", output, size));
+	mu_assert(memcmp(input, output, size) == 0, "should read entry into buffer of its size");
+	free(output);
+	// bytes of larger buffer past the entry are kept
+	output = malloc(size + 16);
+	memset(output + size, 0xAA, 16);
+	mu_assert_int_eq(size, zpak_read_into(zpak, "pattern", output, size + 16));
+	for (int i = size; i < size + 16; i++)
+		mu_assert(output[i] == 0xAA, "should not write past the entry size");
+	free(output);
+	zpak_destruct(zpak);
+}
+
+MU_TEST(it_should_store_incompressible_entries)
+{
+	const int size = 100000;
+	char *noise = malloc(size);
+	char *text = malloc(size);
+	unsigned int state = 2463534242u;
+	for (int i = 0; i < size; i++)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		noise[i] = (char)state;
+		text[i] = "stored or compressed "[(i / 3) % 21];
+	}
+	zpak_write_entry_t entries[] = { { "noise", noise, size }, { "text", text, size }, { "short", noise, 100 } };
+	int flags[] = { ZPAK_F_RW | ZPAK_F_LZS, ZPAK_F_RW | ZPAK_F_LZS | ZPAK_F_CHUNKED };
+	for (int f = 0; f < 2; f++)
+	{
+		zpak_t *zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_write(zpak, "text only", text, size);
+		void *output;
+		int totalSize = zpak_write_end(zpak, &output);
+		mu_assert_int_eq(f ? 2 : 1, ((unsigned char*)output)[5]); // compression type of archive without stored entries
+		free(output);
+		mu_assert_int_eq(size, zpak_write(zpak, "noise", noise, size)); // sampled
+		mu_assert(zpak_write(zpak, "text", text, size) < size / 4, "should compress text entry");
+		mu_assert_int_eq(100, zpak_write(zpak, "short", noise, 100)); // compressed and does not shrink
+		totalSize = zpak_write_end(zpak, &output);
+		zpak_destruct(zpak);
+		mu_assert_int_eq(f ? 4 : 3, ((unsigned char*)output)[5]);
+		zpak = zpak_construct(NULL, NULL, flags[f]);
+		zpak_set_threads(zpak, 4);
+		zpak_write(zpak, "text only", text, size);
+		mu_assert_int_eq(3, zpak_write_batch(zpak, entries, 3, NULL));
+		void *batchOutput;
+		mu_assert_int_eq(totalSize, zpak_write_end(zpak, &batchOutput));
+		mu_assert(memcmp(output, batchOutput, totalSize) == 0, "should store the same entries in batch");
+		free(batchOutput);
+		zpak_destruct(zpak);
+		zpak = zpak_construct(NULL, NULL, ZPAK_F_READ);
+		mu_assert_int_eq(0, zpak_load_static_data(zpak, output, totalSize));
+		mu_assert(zpak_verify(zpak) == 0, zpak_get_last_error(zpak));
+		char *outdata;
+		for (int i = 0; i < 3; i++)
+		{
+			mu_assert_int_eq(entries[i].size, zpak_read(zpak, entries[i].name, (void**)&outdata));
+			mu_assert(memcmp(entries[i].data, outdata, entries[i].size) == 0, "should read stored and compressed entries");
+			free(outdata);
+		}
+		char range[1000];
+		mu_assert_int_eq(1000, zpak_read_range(zpak, "noise", 50000, 1000, range));
+		mu_assert(memcmp(noise + 50000, range, 1000) == 0, "should read range of stored entry");
+		const void *view;
+		mu_assert_int_eq(size, zpak_read_view(zpak, "noise", &view));
+		mu_assert((const char*)view > (const char*)output && (const char*)view < (const char*)output + totalSize, "should view stored entry in place");
+		zpak_release_view(zpak, view);
+		mu_assert_int_eq(size, zpak_read_view(zpak, "text", &view));
+		mu_assert(memcmp(text, view, size) == 0, "should view compressed entry");
+		zpak_release_view(zpak, view);
+		zpak_entry_t *reader = zpak_entry_open(zpak, "noise");
+		mu_assert(reader, "should open stored entry");
+		for (int read = 0; read < size; read += 1000)
+		{
+			mu_assert_int_eq(1000, zpak_entry_read(reader, range, 1000));
+			mu_assert(memcmp(noise + read, range, 1000) == 0, "should stream stored entry");
+		}
+		zpak_entry_close(reader);
+		zpak_destruct(zpak);
+		free(output);
+	}
+	free(noise);
+	free(text);
+}
+
 MU_TEST_SUITE(test_suite) {
 	MU_SUITE_CONFIGURE(&test_setup, &test_teardown);
 	MU_RUN_TEST(it_should_be_constructed_and_destructed);
@@ -228,6 +1355,33 @@ MU_TEST_SUITE(test_suite) {
 	MU_RUN_TEST(it_should_compress_entry_data_using_lzs_compression);
 	MU_RUN_TEST(it_should_decompress_lzs_compressed_entry_data);
 	MU_RUN_TEST(it_should_write_data_in_user_buffer);
+	MU_RUN_TEST(it_should_write_directory_and_read_entries_through_it);
+	MU_RUN_TEST(it_should_rebuild_directory_after_writing_into_loaded_pak);
+	MU_RUN_TEST(it_should_build_lazy_index_for_v1_pak);
+	MU_RUN_TEST(it_should_read_entries_through_perfect_hash);
+	MU_RUN_TEST(it_should_read_entries_through_hash_column);
+	MU_RUN_TEST(it_should_read_many_entries_at_once);
+	MU_RUN_TEST(it_should_list_entries_by_prefix);
+	MU_RUN_TEST(it_should_read_entries_through_handles);
+	MU_RUN_TEST(it_should_read_entries_hashed_word_at_a_time);
+	MU_RUN_TEST(it_should_verify_entry_names_on_hash_collision);
+	MU_RUN_TEST(it_should_cache_lookup_results);
+	MU_RUN_TEST(it_should_reject_missing_entries_with_bloom_filter);
+	MU_RUN_TEST(it_should_verify_pak);
+	MU_RUN_TEST(it_should_stream_entry_in_chunks);
+	MU_RUN_TEST(it_should_read_ranges_of_chunked_entries);
+	MU_RUN_TEST(it_should_compress_chunked_entries_in_parallel);
+	MU_RUN_TEST(it_should_share_cached_entries_within_budget);
+	MU_RUN_TEST(it_should_read_stored_entries_without_copy);
+	MU_RUN_TEST(it_should_read_entries_without_allocations);
+	MU_RUN_TEST(it_should_compress_entries_at_any_level);
+	MU_RUN_TEST(it_should_write_batch_same_as_serial_writes);
+	MU_RUN_TEST(it_should_store_incompressible_entries);
+	MU_RUN_TEST(it_should_replicate_short_match_patterns);
+#ifdef TEST_THREADS
+	MU_RUN_TEST(it_should_read_from_multiple_threads);
+	MU_RUN_TEST(it_should_not_see_errors_of_destructed_context);
+#endif
 }
 
 int main(int argc, char **argv) {
@@ -32,17 +32,100 @@
 #include "zpak.h"
 #include "lzs/lzs.h"
 
+#ifdef ZPAK_THREADS
+	#ifdef _WIN32
+		#include <windows.h>
+		typedef CRITICAL_SECTION zpak_mutex_t;
+		#define MUTEX_INIT(mutex) InitializeCriticalSection(mutex)
+		#define MUTEX_DESTROY(mutex) DeleteCriticalSection(mutex)
+		#define MUTEX_LOCK(mutex) EnterCriticalSection(mutex)
+		#define MUTEX_UNLOCK(mutex) LeaveCriticalSection(mutex)
+	#else
+		#include <pthread.h>
+		#include <unistd.h>
+		typedef pthread_mutex_t zpak_mutex_t;
+		#define MUTEX_INIT(mutex) pthread_mutex_init(mutex, NULL)
+		#define MUTEX_DESTROY(mutex) pthread_mutex_destroy(mutex)
+		#define MUTEX_LOCK(mutex) pthread_mutex_lock(mutex)
+		#define MUTEX_UNLOCK(mutex) pthread_mutex_unlock(mutex)
+	#endif
+#else
+	typedef int zpak_mutex_t;
+	#define MUTEX_INIT(mutex) (void)(mutex)
+	#define MUTEX_DESTROY(mutex) (void)(mutex)
+	#define MUTEX_LOCK(mutex) (void)(mutex)
+	#define MUTEX_UNLOCK(mutex) (void)(mutex)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#if defined(__AVX2__)
+		#define ZPAK_AVX2
+		#include <immintrin.h>
+	#elif defined(__SSE2__)
+		#define ZPAK_SSE2
+		#include <emmintrin.h>
+	#endif
+#endif
+
+#define ZPAK_VERSION_V1 1 // plain entries
+#define ZPAK_VERSION_V2 2 // entries followed by hashed directory and footer
+#define ZPAK_VERSION_V3 3 // v2 with name hash type in the header
+#define ZPAK_VERSION ZPAK_VERSION_V3
+#define ZPAK_HEADER_SIZE_V1 6 // v1 and v2 headers end after compType
 // 262144 bytes
-#define ZPAK_VERSION 1
 #define ZPAK_INIT_SIZE 1024 * 256
 #define ZPAK_BUFFER_PAD 1024
+#define ZPAK_DIR_ALIGN 8
+// flags, which require zpak v2 footer
+#define ZPAK_V2_FLAGS (ZPAK_F_DIRECTORY | ZPAK_F_PERFECT_HASH | ZPAK_F_NAME_INDEX | ZPAK_F_HASH_COLUMN | ZPAK_F_BLOOM)
+// perfect hash parameters, ~43 bits per entry: 8 bit pilot per bucket of 3 entries, 32 bit offset per 0.8 slot load
+#define ZPAK_MPH_BUCKET_SIZE 3
+#define ZPAK_MPH_PILOTS 256
+#define ZPAK_MPH_ATTEMPTS 32
+// lookup cache parameters
+#define ZPAK_CACHE_WAYS 4
+// bloom filter parameters
+#define ZPAK_BLOOM_BLOCK_WORDS 8 // 512 bit blocks, single cache line per lookup
+#define ZPAK_BLOOM_BITS 10 // default bits per entry, ~1% false positive rate
+// chunked entry parameters
+#define ZPAK_CHUNK_SIZE 64 * 1024 // default chunked entry block size
+#define ZPAK_BLOCK_BOUND(size) ((size) + (size) / 8 + 8) // lzs worst case, 9 bits per literal and end marker
+// parallel compression parameters
+#define ZPAK_MAX_THREADS 64
+#define ZPAK_BATCH_WINDOW 16 * 1024 * 1024 // scratch bytes of entries compressed together by zpak_write_batch
+// stored entry detection parameters
+#define ZPAK_SAMPLE_SIZE 1024 // entry sample compressed to detect incompressible data
+#define ZPAK_SAMPLE_COUNT 4 // samples spread over entries larger than ZPAK_SAMPLE_COUNT * ZPAK_SAMPLE_SIZE * 4
 
 typedef struct zpak_header_s {
 	char signature[4]; // ZPAK
 	uint8_t version;
 	uint8_t compType; // 0 -> none, 1 -> lz
+	uint8_t hashType; // since v3, see zpak_hash_type_t
+	uint8_t reserved;
 } zpak_header_t;
 
+typedef enum
+{
+	ZH_DJB2 = 0, // byte at a time, v1 and v2
+	ZH_WORDS = 1 // word at a time
+} zpak_hash_type_t;
+
+typedef enum
+{
+	ZC_NONE = 0,
+	ZC_LZS = 1,
+	ZC_LZS_CHUNKED = 2, // lzs, large entries may be split into blocks
+	ZC_LZS_STORED = 3, // lzs, incompressible entries may be stored
+	ZC_LZS_CHUNKED_STORED = 4 // lzs, entries may be split into blocks or stored
+} zpak_comp_type_t;
+
+typedef enum
+{
+	ZE_CHUNKED = 1, // entry data is chunk header, seek table and independent lzs blocks
+	ZE_STORED = 2 // entry data of lzs zpak is stored uncompressed
+} zpak_entry_flags_t;
+
 typedef struct zpak_entry_header_s {
 	uint32_t size;
 	uint32_t compSize;
@@ -51,19 +134,157 @@ typedef struct zpak_entry_header_s {
 	uint32_t nameLength;
 } zpak_entry_header_t;
 
+// chunked entry data header, followed by block count + 1 block offsets, relative to the first block
+typedef struct zpak_chunk_header_s {
+	uint32_t blockSize; // decompressed size of each block, but the last one
+	uint32_t blockCount;
+} zpak_chunk_header_t;
+
+// decompressed entry data of the entry cache, followed by the data
+typedef struct zpak_payload_s {
+	uint32_t offset; // entry offset, 0 when payload is not in the cache and is freed on the last release
+	uint32_t size;
+	uint32_t refs; // outstanding views
+	uint32_t referenced; // clock bit
+} zpak_payload_t;
+
+// work items, taken by worker threads one at a time
+typedef struct zpak_job_s {
+	void (*run)(void *arg, uint32_t index);
+	void *arg;
+	uint32_t count;
+	volatile uint32_t next;
+} zpak_job_t;
+
+typedef struct zpak_block_job_s {
+	zpak_t *ctx;
+	uint32_t blockSize;
+	uint32_t size; // decompressed entry size
+	uint32_t firstBlock;
+	const uint8_t *input;
+	uint32_t inputSize;
+	uint8_t *output;
+	uint8_t *table; // seek table, block offsets are stored unaligned
+	volatile uint32_t failed; // blocks with malformed seek table, counted atomically by workers
+} zpak_block_job_t;
+
+// scratch slot of batch written entry, size 0 when entry is written on commit
+typedef struct zpak_write_slot_s {
+	uint32_t offset;
+	uint32_t size; // worst case compressed size
+	uint32_t compSize;
+	uint32_t flags; // entry flags
+} zpak_write_slot_t;
+
+typedef struct zpak_write_job_s {
+	zpak_t *ctx;
+	const zpak_write_entry_t *entries;
+	zpak_write_slot_t *slots;
+	uint8_t *scratch;
+} zpak_write_job_t;
+
+// open-addressed (linear probing) hash table slot, offset 0 marks an empty slot
+typedef struct zpak_dir_slot_s {
+	uint64_t nameHash;
+	uint32_t offset; // entry header offset from the blob start
+	uint32_t size;
+	uint32_t compSize;
+	uint32_t reserved;
+} zpak_dir_slot_t;
+
+// trailing v2 structure, always located at the very end of the blob
+// zero offset/slot count marks absent section
+typedef struct zpak_footer_s {
+	uint64_t mphSeed;
+	uint32_t entriesSize; // end of the entries, directory follows after padding
+	uint32_t entryCount;
+	uint32_t dirOffset;
+	uint32_t dirSlots; // power of two
+	uint32_t mphOffset; // uint8_t pilots[mphBuckets], uint32_t offsets[mphSlots] (4 byte aligned)
+	uint32_t mphBuckets;
+	uint32_t mphSlots;
+	uint32_t namesOffset; // zpak_name_record_t records[namesCount] sorted by name, followed by names
+	uint32_t namesCount;
+	uint32_t namesSize;
+	uint32_t hashesOffset; // uint64_t nameHashes[entryCount] in blob order, followed by uint32_t offsets[entryCount]
+	uint32_t bloomOffset; // uint64_t blocks[bloomBlocks * ZPAK_BLOOM_BLOCK_WORDS]
+	uint32_t bloomBlocks;
+	uint32_t bloomProbes;
+	uint32_t footerSize;
+	char signature[4]; // ZDIR
+} zpak_footer_t;
+
+typedef struct zpak_name_record_s {
+	uint32_t nameOffset; // from the names section start
+	uint32_t entryOffset;
+	uint32_t size;
+} zpak_name_record_t;
+
+// name index under construction
+typedef struct zpak_name_key_s {
+	const char *name;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t nameLength;
+} zpak_name_key_t;
+
+// perfect hash (PTHash-like hash and displace) under construction
+typedef struct zpak_mph_s {
+	uint64_t seed;
+	uint32_t buckets;
+	uint32_t slots;
+	uint8_t *pilots;
+	uint32_t *offsets; // entry offset per slot, 0 -> empty slot
+} zpak_mph_t;
+
+typedef struct zpak_mph_key_s {
+	uint64_t nameHash;
+	uint64_t mixed;
+	uint32_t offset;
+	uint32_t bucket;
+} zpak_mph_key_t;
+
+// lookup cache slot, sets of ZPAK_CACHE_WAYS slots
+typedef struct zpak_cache_slot_s {
+	uint64_t nameHash;
+	uint32_t offset; // 0 -> there is no entry with this name hash
+	uint8_t used;
+	uint8_t referenced; // clock bit
+} zpak_cache_slot_t;
+
+// zpak_read_many request table slot
+typedef struct zpak_request_slot_s {
+	uint64_t nameHash;
+	int head; // first request index, -1 -> empty slot
+	int pending; // unresolved requests in the chain
+} zpak_request_slot_t;
+
 typedef enum
 {
-	ZO_STATIC_DATA = 1 // no deallocation, external static buffer
+	ZO_STATIC_DATA = 1, // no deallocation, external static buffer
+	ZO_LAZY_INDEX = 2, // build in-memory index on first lookup
+	ZO_VALIDATED = 4 // blob passed zpak_verify
 } zpak_options_t;
 
-typedef struct {
-	zpak_it_t *it;
-	uint64_t cursor;
-} zpak_entry_handle_t;
-
-#define MAX_ENTRY_HANDLES 16
+// streaming entry reader, keeps offsets instead of pointers, so the blob may be reallocated by writes in between reads
+struct zpak_entry_s {
+	zpak_t *ctx;
+	uint32_t dataOffset; // entry data offset in the blob, first block offset for chunked entry
+	uint32_t compSize;
+	uint32_t tableOffset; // chunked entry seek table offset in the blob
+	uint32_t consumed; // consumed entry data bytes
+	uint32_t remaining; // decompressed bytes left
+	uint32_t streamEnd; // entry data offset, where current lzs stream ends
+	uint32_t streamRemaining; // decompressed bytes left in current lzs stream
+	uint32_t blockSize; // chunked entry blocks, 0 when entry is a single stream
+	uint32_t blockCount;
+	uint32_t blockIndex;
+	int stored; // entry data is copied as is
+	LzsDecompressParameters_t lzs;
+};
 
 struct zpak_s {
+	uint32_t id; // identifies the context in per thread error state
 	zpak_alloc_fn alloc;
 	zpak_logger_fn logger;
 	void* memctx; // allocator context
@@ -73,26 +294,136 @@ struct zpak_s {
 	const void *staticData;
 	uint32_t curSize; // buffer write size
 	uint32_t bufSize; // buffer allocated size (which may be bigger)
-	const char *err;
-	// zpak_entry_handle_t handles[MAX_ENTRY_HANDLES];
+	uint32_t entryCount; // entry count, as recorded in the directory
+	uint32_t dirOffset; // loaded directory offset
+	uint32_t dirSlots; // loaded directory slot count, 0 when there is no directory
+	uint64_t mphSeed; // loaded perfect hash
+	uint32_t mphOffset;
+	uint32_t mphBuckets;
+	uint32_t mphSlots; // 0 when there is no perfect hash
+	uint32_t namesOffset; // loaded name index, 0 when there is no name index
+	uint32_t namesCount;
+	uint32_t namesSize;
+	uint32_t hashesOffset; // loaded hash column, 0 when there is no hash column
+	uint32_t bloomOffset; // loaded bloom filter, 0 when there is no bloom filter
+	uint32_t bloomBlocks;
+	uint32_t bloomProbes;
+	uint32_t bloomBits; // bits per entry of written bloom filter
+	uint32_t chunkSize; // block size of written chunked entries
+	uint32_t threads; // chunked entry worker threads, 0 uses all cores
+	int level; // lzs compression level of written entries
+	uint32_t entriesStart; // header size
+	zpak_hash_type_t hashType;
+	zpak_dir_slot_t *index; // lazily built in-memory directory, published once built
+	uint32_t indexSlots;
+	zpak_mutex_t indexLock;
+	zpak_cache_slot_t *cache; // lookup cache, followed by clock hand per set
+	uint32_t cacheSets;
+	uint32_t cacheHits;
+	uint32_t cacheMisses;
+	zpak_mutex_t cacheLock;
+	uint32_t bloomRejects;
+	zpak_payload_t **payloads; // entry cache, open addressed by entry offset
+	uint32_t payloadSlots;
+	uint32_t payloadCount;
+	uint32_t payloadMemory;
+	uint32_t payloadBudget; // 0 when there is no entry cache
+	uint32_t payloadHand; // clock hand
+	uint32_t viewCount; // outstanding views of stored entries, which point into the blob
+	uint32_t payloadHits;
+	uint32_t payloadMisses;
+	uint32_t payloadEvictions;
+	zpak_mutex_t payloadLock;
 };
 
+typedef enum
+{
+	ZI_ENTRIES = 0, // all entries in the blob order
+	ZI_PREFIX_SCAN, // entries matching prefix in the blob order
+	ZI_PREFIX_RANGE // name index range, in the name order
+} zpak_it_mode_t;
+
 struct zpak_it_s {
 	zpak_t *ctx;
 	uint32_t current;
+	zpak_it_mode_t mode;
+	const char *prefix;
+	uint32_t prefixLength;
+	uint32_t rangeIndex; // next name record
+	uint32_t rangeEnd;
 };
 
+// iterator must fit into the public storage
+typedef char zpak_it_size_check_t[sizeof(struct zpak_it_s) <= ZPAK_IT_SIZE ? 1 : -1];
+
 static void* __default_alloc(void *memctx, void *ptr, int size);
 static void  __default_logger(const char *message);
 static void* __start_zpak(zpak_t *ctx);
 static void* __resize_zpak_buffer(zpak_t *ctx, uint32_t newSize);
 static uint32_t __calc_entry_size(const zpak_entry_header_t *entry);
-static uint32_t __it_read_and_destruct(zpak_it_t *it, void **data);
+static size_t __decompress(zpak_t *ctx, uint8_t *data, size_t size, const uint8_t *compData, size_t compSize);
+static uint32_t __compress_chunked(zpak_t *ctx, uint8_t *compData, const uint8_t *data, uint32_t size);
+static uint32_t __calc_write_bound(zpak_t *ctx, int size, int *chunked);
+static int __reserve_entry(zpak_t *ctx, const char *entryName, int size, uint32_t dataSize, zpak_entry_header_t **entry);
+static int __commit_entry(zpak_t *ctx, zpak_entry_header_t *entry);
+static void __compress_entry(void *arg, uint32_t index);
+static uint32_t __encode_entry(zpak_t *ctx, uint8_t *compData, uint32_t dataSize, const uint8_t *data, uint32_t size, int chunked, uint32_t *flags);
+static int __is_compressible(const uint8_t *data, uint32_t size);
+static int __is_stored(zpak_t *ctx, const zpak_entry_header_t *entry);
+static int __read_range(zpak_t *ctx, const zpak_entry_header_t *entry, uint32_t offset, uint32_t length, uint8_t *data);
+static int __verify_chunks(zpak_t *ctx, const zpak_entry_header_t *entry, const uint8_t *compData);
+static int __entry_next_block(zpak_entry_t *reader);
+static void __compress_block(void *arg, uint32_t index);
+static void __decompress_block(void *arg, uint32_t index);
+static void __run_job(zpak_t *ctx, zpak_job_t *job);
+#ifdef ZPAK_THREADS
+static uint32_t __get_thread_count(zpak_t *ctx);
+#endif
+static int __verify_sections(zpak_t *ctx, const uint32_t *offsets, uint32_t count);
+static int __is_entry_offset(const uint32_t *offsets, uint32_t count, uint32_t offset);
+static void __resolve_many_by_scan(zpak_t *ctx, const char **entryNames, const uint32_t *nameLengths, const uint64_t *hashes, zpak_read_result_t *results, uint32_t *offsets, int count);
 static uint64_t __hash_string(const uint8_t *str);
+static uint64_t __hash_words(const uint8_t *str, uint32_t length);
+static uint64_t __read32(const uint8_t *p);
+static uint64_t __hash_name(zpak_t *ctx, const char *name, uint32_t *nameLength);
+static int __match_entry_name(const zpak_entry_header_t *entry, const char *name, uint32_t nameLength);
+static zpak_it_t __it_at(zpak_t *ctx, uint32_t offset);
 static const zpak_entry_header_t* __it_get_entry_header(zpak_it_t *it);
+static int __load_directory(zpak_t *ctx, const void *data, uint32_t size);
+static uint32_t __find_entry(zpak_t *ctx, const char *entryName, uint32_t nameLength, uint64_t entryNameHash);
+static uint32_t __scan_entries(zpak_t *ctx, const char *entryName, uint32_t nameLength, uint64_t entryNameHash, int *hashSeen);
+static uint32_t __lookup_entry(zpak_t *ctx, const char *entryName, uint32_t nameLength, uint64_t entryNameHash, int *hashSeen);
+static void __cache_insert(zpak_t *ctx, uint64_t nameHash, uint32_t offset);
+static void __clear_lookup_cache(zpak_t *ctx);
+static zpak_payload_t* __payload_find(zpak_t *ctx, uint32_t offset);
+static int __read_cached(zpak_t *ctx, uint32_t offset, const void **data);
+static int __payload_insert(zpak_t *ctx, zpak_payload_t *payload);
+static void __payload_remove(zpak_t *ctx, uint32_t slot);
+static void __payload_evict(zpak_t *ctx, uint32_t size);
+static void __clear_entry_cache(zpak_t *ctx);
+static int __may_contain(zpak_t *ctx, uint64_t nameHash);
+static void __bloom_insert(uint64_t *blocks, uint32_t blockCount, uint32_t probes, uint64_t nameHash);
+static uint64_t __mix64(uint64_t x);
+static uint32_t __fast_range(uint32_t value, uint32_t range);
+static const zpak_dir_slot_t* __get_dir(zpak_t *ctx, uint32_t *slotCount);
+static uint32_t __dir_slot_index(uint64_t nameHash, uint32_t slotCount);
+static uint32_t __dir_find(const zpak_dir_slot_t *slots, uint32_t slotCount, uint64_t nameHash);
+static uint32_t __dir_insert(zpak_dir_slot_t *slots, uint32_t slotCount, const zpak_entry_header_t *entry, uint32_t offset);
+static uint32_t __calc_dir_slots(uint32_t entryCount);
+static zpak_dir_slot_t* __build_index(zpak_t *ctx);
+static int __build_mph(zpak_t *ctx, uint32_t entryCount, zpak_mph_t *mph);
+static void __free_mph(zpak_t *ctx, zpak_mph_t *mph);
+static uint32_t __mph_find(zpak_t *ctx, const void *blob, uint64_t nameHash);
+static zpak_name_key_t* __build_name_index(zpak_t *ctx, uint32_t entryCount, uint32_t *namesSize);
+static const zpak_name_record_t* __get_name_records(zpak_t *ctx);
+static const char* __get_record_name(zpak_t *ctx, const zpak_name_record_t *record);
+static void __free_index(zpak_t *ctx);
+static void __set_error(zpak_t *ctx, const char *message);
+static int __is_valid_handle(zpak_t *ctx, zpak_handle_t handle);
+static uint32_t __scan_hashes(const uint64_t *hashes, uint32_t count, uint64_t nameHash);
 
 #define SET_ERROR(str) \
-	ctx->err = str; \
+	__set_error(ctx, str); \
 	return -1; \
 
 #define SET_STR(dest, str) \
@@ -119,6 +450,42 @@ static const zpak_entry_header_t* __it_get_entry_header(zpak_it_t *it);
 #define M_MIN(a, b) a < b ? a : b
 #define M_MAX(a, b) a > b ? a : b
 
+#define ALIGN(value, alignment) (((value) + (alignment) - 1) & ~((alignment) - 1))
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define PREFETCH(ptr) __builtin_prefetch(ptr)
+#else
+	#define PREFETCH(ptr)
+#endif
+
+#if defined(ZPAK_THREADS) && defined(_WIN32)
+	#define ATOMIC_NEXT(value) (uint32_t)(InterlockedIncrement((volatile LONG*)(value)) - 1)
+	#define ATOMIC_LOAD_PTR(ptr) InterlockedCompareExchangePointer((PVOID volatile*)(ptr), NULL, NULL)
+	#define ATOMIC_STORE_PTR(ptr, value) InterlockedExchangePointer((PVOID volatile*)(ptr), value)
+#elif defined(ZPAK_THREADS)
+	#define ATOMIC_NEXT(value) __atomic_fetch_add(value, 1, __ATOMIC_RELAXED)
+	#define ATOMIC_LOAD_PTR(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+	#define ATOMIC_STORE_PTR(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#else
+	#define ATOMIC_NEXT(value) (*(value))++
+	#define ATOMIC_LOAD_PTR(ptr) *(ptr)
+	#define ATOMIC_STORE_PTR(ptr, value) *(ptr) = value
+#endif
+
+#if defined(ZPAK_THREADS) && defined(_MSC_VER)
+	#define THREAD_LOCAL __declspec(thread)
+#elif defined(ZPAK_THREADS)
+	#define THREAD_LOCAL __thread
+#else
+	#define THREAD_LOCAL
+#endif
+
+// last error is kept per thread, so concurrent readers do not share error state, 
+// contexts are told apart by id, as a new context may be allocated at the address of destructed one
+static volatile uint32_t __lastCtxId;
+static THREAD_LOCAL uint32_t __errorCtxId;
+static THREAD_LOCAL const char *__errorMessage;
+
 #define GET_ZPAK_BLOB(ctx) ctx->opt & ZO_STATIC_DATA ? ctx->staticData : ctx->data;
 
 zpak_t* zpak_construct(zpak_alloc_fn allocator, void* memctx, unsigned int flags)
@@ -134,11 +501,26 @@ zpak_t* zpak_construct(zpak_alloc_fn allocator, void* memctx, unsigned int flags
 	if (flags == 0)
 		flags = ZPAK_F_RW | ZPAK_F_LZS;
 	ctx->flags = flags;
+	ctx->threads = 1;
+	ctx->level = LZS_LEVEL_DEFAULT;
+	ctx->id = ATOMIC_NEXT(&__lastCtxId) + 1;
+	MUTEX_INIT(&ctx->payloadLock);
+	MUTEX_INIT(&ctx->indexLock);
+	MUTEX_INIT(&ctx->cacheLock);
 	return ctx;
 }
 
 int zpak_destruct(zpak_t *ctx)
 {
+	__free_index(ctx);
+	__clear_entry_cache(ctx);
+	MUTEX_DESTROY(&ctx->payloadLock);
+	MUTEX_DESTROY(&ctx->indexLock);
+	MUTEX_DESTROY(&ctx->cacheLock);
+	if (__errorCtxId == ctx->id)
+		__errorCtxId = 0;
+	if (ctx->cache)
+		ctx->alloc(ctx->memctx, ctx->cache, 0);
 	if (!(ctx->opt & ZO_STATIC_DATA))
 	{
 		if (ctx->data)
@@ -154,17 +536,20 @@ int zpak_load_data(zpak_t *ctx, const void *data, unsigned int size)
 {
 	ASSERT(data, "no data was passed");
 	ASSERT(size > 0, "data buffer with incorrect size");
-	ASSERT(size >= sizeof(zpak_header_t), "data buffer is too small to be processed");
+	ASSERT(size >= ZPAK_HEADER_SIZE_V1, "data buffer is too small to be processed");
 	ASSERT(!ctx->data, "internal data buffer already exists");
 	zpak_header_t *header = (zpak_header_t*)data;
 	ASSERT(strncmp(header->signature, "ZPAK", 4) == 0, "data buffer is not valid zpak");
-	ASSERT(header->version == 1, "unsupported zpak version");
-	ASSERT(header->compType <= 1, "unsupported zpak compression type");
+	ASSERT(header->version >= ZPAK_VERSION_V1 && header->version <= ZPAK_VERSION, "unsupported zpak version");
+	ASSERT(header->compType <= ZC_LZS_CHUNKED_STORED, "unsupported zpak compression type");
+	if (__load_directory(ctx, data, size) == -1)
+		return -1;
 	ctx->bufSize = size;
-	ctx->curSize = size;
 	ctx->data = ctx->alloc(ctx->memctx, NULL, size);
-	if (header->compType == 1) 
+	if (header->compType != ZC_NONE) 
 		ctx->flags |= ZPAK_F_LZS;
+	if (header->compType == ZC_LZS_CHUNKED || header->compType == ZC_LZS_CHUNKED_STORED) 
+		ctx->flags |= ZPAK_F_CHUNKED;
 	ASSERT(ctx->data, "could not allocate internal buffer");
 	memcpy(ctx->data, data, size);
 	return 0;
@@ -174,20 +559,23 @@ int zpak_load_static_data(zpak_t *ctx, const void *data, unsigned int size)
 {
 	ASSERT(data, "no data was passed");
 	ASSERT(size > 0, "data buffer with incorrect size");
-	ASSERT(size >= sizeof(zpak_header_t), "data buffer is too small to be processed");
+	ASSERT(size >= ZPAK_HEADER_SIZE_V1, "data buffer is too small to be processed");
 	ASSERT(!ctx->data, "internal data buffer already exists");
 	ASSERT(!ctx->staticData, "internal static data buffer already exists");
 	zpak_header_t *header = (zpak_header_t*)data;
 	ASSERT(strncmp(header->signature, "ZPAK", 4) == 0, "data buffer is not valid zpak");
-	ASSERT(header->version == 1, "unsupported zpak version");
-	ASSERT(header->compType <= 1, "unsupported zpak compression type");
+	ASSERT(header->version >= ZPAK_VERSION_V1 && header->version <= ZPAK_VERSION, "unsupported zpak version");
+	ASSERT(header->compType <= ZC_LZS_CHUNKED_STORED, "unsupported zpak compression type");
+	ctx->flags = ZPAK_F_READ;
+	if (__load_directory(ctx, data, size) == -1)
+		return -1;
 	ctx->bufSize = size;
-	ctx->curSize = size;
 	ctx->opt |= ZO_STATIC_DATA;
-	ctx->flags = ZPAK_F_READ;
 	ctx->staticData = data;
-	if (header->compType == 1) 
+	if (header->compType != ZC_NONE) 
 		ctx->flags |= ZPAK_F_LZS;
+	if (header->compType == ZC_LZS_CHUNKED || header->compType == ZC_LZS_CHUNKED_STORED) 
+		ctx->flags |= ZPAK_F_CHUNKED;
 	return 0;
 }
 
@@ -198,10 +586,122 @@ int zpak_write(zpak_t *ctx, const char *entryName, const void *data, int size)
 	ASSERT(data, "no data was passed");
 	ASSERT(size > 0, "data buffer with incorrect size");
 	ASSERT(!(ctx->flags & ZPAK_F_READ), "cannot write entry in non-writable zpak");
-	ASSERT(ctx->data || __start_zpak(ctx), "could not allocate internal buffer");
 
-	uint32_t nameLength = strlen(entryName) + 1;
-	uint32_t dataSize = size + ZPAK_BUFFER_PAD; // compensate negative compression
+	int chunked;
+	uint32_t dataSize = __calc_write_bound(ctx, size, &chunked);
+	zpak_entry_header_t *entry;
+	if (__reserve_entry(ctx, entryName, size, dataSize, &entry) == -1)
+		return -1;
+	uint8_t *cursor = (uint8_t*)(entry + 1) + entry->nameLength;
+	entry->compSize = __encode_entry(ctx, cursor, dataSize, data, size, chunked, &entry->flags);
+	return __commit_entry(ctx, entry);
+}
+
+int zpak_write_batch(zpak_t *ctx, const zpak_write_entry_t *entries, int count, int *compSizes)
+{
+	ASSERT(count >= 0, "entry count should not be negative");
+	ASSERT(entries || !count, "no entries were passed");
+	ASSERT(!(ctx->opt & ZO_STATIC_DATA), "cannot write entry into static data buffer");
+	ASSERT(!(ctx->flags & ZPAK_F_READ), "cannot write entry in non-writable zpak");
+	ASSERT(!ctx->viewCount, "cannot write entry while stored entry views are not released");
+	for (int i = 0; i < count; i++)
+	{
+		ASSERT(entries[i].name && entries[i].name[0], "entry name should not be an emptry string");
+		ASSERT(entries[i].data, "no data was passed");
+		ASSERT(entries[i].size > 0, "data buffer with incorrect size");
+	}
+	if (!count)
+		return 0;
+	zpak_write_slot_t *slots = ctx->alloc(ctx->memctx, NULL, count * sizeof(zpak_write_slot_t));
+	ASSERT(slots, "could not allocate batch slots");
+	uint8_t *scratch = NULL;
+	uint32_t scratchSize = 0;
+	int result = count;
+	for (int first = 0, last; first < count && result != -1; first = last)
+	{
+		// window of lzs entries compressed together into scratch slots of worst case size, 
+		// chunked and stored entries get slot of zero size and are written on commit
+		uint32_t windowSize = 0;
+		for (last = first; last < count; last++)
+		{
+			int chunked;
+			uint32_t bound = __calc_write_bound(ctx, entries[last].size, &chunked);
+			if (chunked || !(ctx->flags & ZPAK_F_LZS))
+				bound = 0;
+			if (last > first && windowSize + bound > ZPAK_BATCH_WINDOW)
+				break;
+			slots[last].offset = windowSize;
+			slots[last].size = bound;
+			windowSize += bound;
+		}
+		if (windowSize > scratchSize)
+		{
+			uint8_t *newScratch = ctx->alloc(ctx->memctx, scratch, windowSize);
+			if (!newScratch)
+			{
+				__set_error(ctx, "could not allocate batch scratch buffer");
+				result = -1;
+				break;
+			}
+			scratch = newScratch;
+			scratchSize = windowSize;
+		}
+		zpak_write_job_t writeJob = { ctx, entries + first, slots + first, scratch };
+		zpak_job_t job = { __compress_entry, &writeJob, last - first, 0 };
+		__run_job(ctx, &job);
+		// commit in entry order, the blob is the same as of serial writes
+		for (int i = first; i < last; i++)
+		{
+			int compSize;
+			zpak_entry_header_t *entry;
+			if (!slots[i].size)
+				compSize = zpak_write(ctx, entries[i].name, entries[i].data, entries[i].size);
+			else if (__reserve_entry(ctx, entries[i].name, entries[i].size, slots[i].size, &entry) == -1)
+				compSize = -1;
+			else
+			{
+				memcpy((uint8_t*)(entry + 1) + entry->nameLength, scratch + slots[i].offset, slots[i].compSize);
+				entry->compSize = slots[i].compSize;
+				entry->flags = slots[i].flags;
+				compSize = __commit_entry(ctx, entry);
+			}
+			if (compSize == -1)
+			{
+				result = -1;
+				break;
+			}
+			if (compSizes)
+				compSizes[i] = compSize;
+		}
+	}
+	if (scratch)
+		ctx->alloc(ctx->memctx, scratch, 0);
+	ctx->alloc(ctx->memctx, slots, 0);
+	return result;
+}
+
+// returns worst case size of written entry data
+static uint32_t __calc_write_bound(zpak_t *ctx, int size, int *chunked)
+{
+	uint32_t chunkSize = ctx->chunkSize ? ctx->chunkSize : ZPAK_CHUNK_SIZE;
+	*chunked = (ctx->flags & ZPAK_F_LZS) && (ctx->flags & ZPAK_F_CHUNKED) && (uint32_t)size > chunkSize;
+	if (*chunked)
+	{
+		// each block is compressed in its own worst case sized slot, then blocks are packed
+		uint32_t blockCount = (size - 1) / chunkSize + 1;
+		return sizeof(zpak_chunk_header_t) + (blockCount + 1) * sizeof(uint32_t) + blockCount * ZPAK_BLOCK_BOUND(chunkSize);
+	}
+	return size + ZPAK_BUFFER_PAD; // compensate negative compression
+}
+
+// makes room for entry with data of dataSize at the end of the blob, writes entry header except compSize and name
+static int __reserve_entry(zpak_t *ctx, const char *entryName, int size, uint32_t dataSize, zpak_entry_header_t **entry)
+{
+	ASSERT(!ctx->viewCount, "cannot write entry while stored entry views are not released");
+	ASSERT(ctx->data || __start_zpak(ctx), "could not allocate internal buffer");
+	uint32_t nameLength;
+	uint64_t nameHash = __hash_name(ctx, entryName, &nameLength);
+	nameLength++;
 	uint32_t estimatedSpace = sizeof(zpak_entry_header_t) + nameLength + dataSize;  
 	uint32_t remainingSpace = ctx->bufSize - ctx->curSize;
 	if (estimatedSpace > remainingSpace)
@@ -213,36 +713,236 @@ int zpak_write(zpak_t *ctx, const char *entryName, const void *data, int size)
 		}
 	}
 	uint8_t *cursor = (uint8_t*)ctx->data + ctx->curSize;
-	zpak_entry_header_t *entry = (zpak_entry_header_t*)cursor;
-	entry->size = size;
-	entry->nameHash = __hash_string((const uint8_t*)entryName);
-	entry->nameLength = nameLength;
+	*entry = (zpak_entry_header_t*)cursor;
+	(*entry)->size = size;
+	(*entry)->nameHash = nameHash;
+	(*entry)->flags = 0;
+	(*entry)->nameLength = nameLength;
 	cursor += sizeof(zpak_entry_header_t);
 	SET_STR(cursor, entryName);
-	cursor += nameLength;
-	if (ctx->flags & ZPAK_F_LZS) 
+	return 0;
+}
+
+// appends reserved entry with compSize set to the blob, returns compSize
+static int __commit_entry(zpak_t *ctx, zpak_entry_header_t *entry)
+{
+	ctx->curSize += __calc_entry_size(entry);
+	// older readers reject chunked and stored entries by compression type instead of decompressing them
+	zpak_header_t *header = (zpak_header_t*)ctx->data;
+	if (entry->flags & (ZE_CHUNKED | ZE_STORED))
 	{
-		size_t compSize = lzs_compress(cursor, dataSize, data, size);
-		entry->compSize = compSize;
+		int chunked = (entry->flags & ZE_CHUNKED) || header->compType == ZC_LZS_CHUNKED || header->compType == ZC_LZS_CHUNKED_STORED;
+		int stored = (entry->flags & ZE_STORED) || header->compType == ZC_LZS_STORED || header->compType == ZC_LZS_CHUNKED_STORED;
+		if (stored)
+			header->compType = chunked ? ZC_LZS_CHUNKED_STORED : ZC_LZS_STORED;
+		else
+			header->compType = ZC_LZS_CHUNKED;
 	}
-	else
+	// loaded directory no longer covers all entries, it is rebuilt in zpak_write_end
+	ctx->dirSlots = 0;
+	ctx->mphSlots = 0;
+	ctx->namesOffset = 0;
+	ctx->hashesOffset = 0;
+	ctx->bloomOffset = 0;
+	ctx->opt &= ~ZO_VALIDATED;
+	__free_index(ctx);
+	__clear_lookup_cache(ctx);
+	__clear_entry_cache(ctx);
+	return entry->compSize;
+}
+
+// compresses lzs entry into its scratch slot
+static void __compress_entry(void *arg, uint32_t index)
+{
+	zpak_write_job_t *job = (zpak_write_job_t*)arg;
+	zpak_write_slot_t *slot = job->slots + index;
+	if (!slot->size)
+		return;
+	const zpak_write_entry_t *entry = job->entries + index;
+	slot->compSize = __encode_entry(job->ctx, job->scratch + slot->offset, slot->size, entry->data, entry->size, 0, &slot->flags);
+}
+
+// writes entry data of __calc_write_bound size, lzs entries that do not shrink are stored, returns compSize
+static uint32_t __encode_entry(zpak_t *ctx, uint8_t *compData, uint32_t dataSize, const uint8_t *data, uint32_t size, int chunked, uint32_t *flags)
+{
+	*flags = 0;
+	if (!(ctx->flags & ZPAK_F_LZS))
 	{
-		memcpy(cursor, data, size);
-		entry->compSize = size;
+		memcpy(compData, data, size);
+		return size;
 	}
-	cursor += entry->compSize;
-	ctx->curSize += cursor - ((uint8_t*)ctx->data + ctx->curSize);
-	return entry->compSize;
+	if (__is_compressible(data, size))
+	{
+		uint32_t compSize = chunked 
+			? __compress_chunked(ctx, compData, data, size) 
+			: lzs_compress_level(compData, dataSize, data, size, ctx->level);
+		if (compSize < size)
+		{
+			*flags = chunked ? ZE_CHUNKED : 0;
+			return compSize;
+		}
+	}
+	*flags = ZE_STORED;
+	memcpy(compData, data, size);
+	return size;
+}
+
+// compresses a few samples of large entry at the fast level, 
+// already compressed data (images, audio, archives) does not shrink
+static int __is_compressible(const uint8_t *data, uint32_t size)
+{
+	if (size <= ZPAK_SAMPLE_COUNT * ZPAK_SAMPLE_SIZE * 4)
+		return 1;
+	uint8_t compData[ZPAK_BLOCK_BOUND(ZPAK_SAMPLE_SIZE)];
+	uint32_t step = (size - ZPAK_SAMPLE_SIZE) / (ZPAK_SAMPLE_COUNT - 1);
+	size_t compSize = 0;
+	for (uint32_t i = 0; i < ZPAK_SAMPLE_COUNT; i++)
+		compSize += lzs_compress_level(compData, sizeof(compData), data + i * step, ZPAK_SAMPLE_SIZE, LZS_LEVEL_FAST);
+	return compSize < ZPAK_SAMPLE_COUNT * ZPAK_SAMPLE_SIZE;
+}
+
+// entries of zpak without ZPAK_F_LZS and incompressible entries are stored as is
+static int __is_stored(zpak_t *ctx, const zpak_entry_header_t *entry)
+{
+	return !(ctx->flags & ZPAK_F_LZS) || (entry->flags & ZE_STORED);
 }
 
 int zpak_write_end(zpak_t *ctx, void **data)
 {
 	ASSERT(!(ctx->opt & ZO_STATIC_DATA), "cannot flush static data");
 	ASSERT(ctx->data, "no data to flush");
-	*data = ctx->alloc(ctx->memctx, NULL, ctx->curSize);
-	ASSERT(*data, "could not allocate zpak output buffer");
-	memcpy(*data, ctx->data, ctx->curSize); 
-	return ctx->curSize;
+	uint8_t version = ((const zpak_header_t*)ctx->data)->version;
+	if (version == ZPAK_VERSION_V1 && !(ctx->flags & ZPAK_V2_FLAGS))
+	{
+		*data = ctx->alloc(ctx->memctx, NULL, ctx->curSize);
+		ASSERT(*data, "could not allocate zpak output buffer");
+		memcpy(*data, ctx->data, ctx->curSize); 
+		return ctx->curSize;
+	}
+	zpak_it_t it = __it_at(ctx, 0);
+	zpak_footer_t footer;
+	memset(&footer, 0, sizeof(zpak_footer_t));
+	while (zpak_it_next(&it))
+		footer.entryCount++;
+	footer.entriesSize = ctx->curSize;
+	uint32_t totalSize = ALIGN(ctx->curSize, ZPAK_DIR_ALIGN);
+	if (ctx->flags & ZPAK_F_DIRECTORY)
+	{
+		footer.dirOffset = totalSize;
+		footer.dirSlots = __calc_dir_slots(footer.entryCount);
+		totalSize += footer.dirSlots * sizeof(zpak_dir_slot_t);
+	}
+	zpak_mph_t mph;
+	memset(&mph, 0, sizeof(zpak_mph_t));
+	if (ctx->flags & ZPAK_F_PERFECT_HASH)
+	{
+		if (__build_mph(ctx, footer.entryCount, &mph) == -1)
+		{
+			__free_mph(ctx, &mph);
+			SET_ERROR("could not build perfect hash directory");
+		}
+		footer.mphSeed = mph.seed;
+		footer.mphOffset = totalSize;
+		footer.mphBuckets = mph.buckets;
+		footer.mphSlots = mph.slots;
+		totalSize += ALIGN(mph.buckets, 4) + mph.slots * sizeof(uint32_t);
+		totalSize = ALIGN(totalSize, ZPAK_DIR_ALIGN);
+	}
+	zpak_name_key_t *names = NULL;
+	if (ctx->flags & ZPAK_F_NAME_INDEX)
+	{
+		names = __build_name_index(ctx, footer.entryCount, &footer.namesSize);
+		if (!names)
+		{
+			__free_mph(ctx, &mph);
+			SET_ERROR("could not build name index");
+		}
+		footer.namesOffset = totalSize;
+		footer.namesCount = footer.entryCount;
+		totalSize += ALIGN(footer.namesSize, ZPAK_DIR_ALIGN);
+	}
+	if (ctx->flags & ZPAK_F_HASH_COLUMN)
+	{
+		footer.hashesOffset = totalSize;
+		totalSize += ALIGN(footer.entryCount * (sizeof(uint64_t) + sizeof(uint32_t)), ZPAK_DIR_ALIGN);
+	}
+	if (ctx->flags & ZPAK_F_BLOOM)
+	{
+		uint32_t bits = ctx->bloomBits ? ctx->bloomBits : ZPAK_BLOOM_BITS;
+		uint64_t totalBits = (uint64_t)footer.entryCount * bits;
+		footer.bloomOffset = totalSize;
+		footer.bloomBlocks = (uint32_t)((totalBits + ZPAK_BLOOM_BLOCK_WORDS * 64 - 1) / (ZPAK_BLOOM_BLOCK_WORDS * 64));
+		if (!footer.bloomBlocks)
+			footer.bloomBlocks = 1;
+		// optimal probe count is bits * ln(2)
+		footer.bloomProbes = M_MIN((bits * 693 + 500) / 1000, 16);
+		if (!footer.bloomProbes)
+			footer.bloomProbes = 1;
+		totalSize += footer.bloomBlocks * ZPAK_BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+	}
+	footer.footerSize = sizeof(zpak_footer_t);
+	memcpy(footer.signature, "ZDIR", 4);
+	totalSize += sizeof(zpak_footer_t);
+	uint8_t *output = ctx->alloc(ctx->memctx, NULL, totalSize);
+	if (!output)
+	{
+		__free_mph(ctx, &mph);
+		if (names)
+			ctx->alloc(ctx->memctx, names, 0);
+		SET_ERROR("could not allocate zpak output buffer");
+	}
+	memcpy(output, ctx->data, ctx->curSize);
+	memset(output + ctx->curSize, 0, totalSize - ctx->curSize);
+	((zpak_header_t*)output)->version = M_MAX(version, ZPAK_VERSION_V2);
+	if (footer.dirSlots)
+	{
+		zpak_dir_slot_t *slots = (zpak_dir_slot_t*)(output + footer.dirOffset);
+		it.current = 0;
+		while (zpak_it_next(&it))
+			__dir_insert(slots, footer.dirSlots, __it_get_entry_header(&it), it.current);
+	}
+	if (footer.mphSlots)
+	{
+		memcpy(output + footer.mphOffset, mph.pilots, mph.buckets);
+		memcpy(output + footer.mphOffset + ALIGN(mph.buckets, 4), mph.offsets, mph.slots * sizeof(uint32_t));
+		__free_mph(ctx, &mph);
+	}
+	if (names)
+	{
+		zpak_name_record_t *records = (zpak_name_record_t*)(output + footer.namesOffset);
+		uint32_t nameOffset = footer.namesCount * sizeof(zpak_name_record_t);
+		for (uint32_t i = 0; i < footer.namesCount; i++)
+		{
+			records[i].nameOffset = nameOffset;
+			records[i].entryOffset = names[i].offset;
+			records[i].size = names[i].size;
+			memcpy(output + footer.namesOffset + nameOffset, names[i].name, names[i].nameLength);
+			nameOffset += names[i].nameLength;
+		}
+		ctx->alloc(ctx->memctx, names, 0);
+	}
+	if (footer.hashesOffset)
+	{
+		uint64_t *hashes = (uint64_t*)(output + footer.hashesOffset);
+		uint32_t *offsets = (uint32_t*)(hashes + footer.entryCount);
+		uint32_t i = 0;
+		it.current = 0;
+		while (zpak_it_next(&it))
+		{
+			hashes[i] = __it_get_entry_header(&it)->nameHash;
+			offsets[i++] = it.current;
+		}
+	}
+	if (footer.bloomOffset)
+	{
+		uint64_t *blocks = (uint64_t*)(output + footer.bloomOffset);
+		it.current = 0;
+		while (zpak_it_next(&it))
+			__bloom_insert(blocks, footer.bloomBlocks, footer.bloomProbes, __it_get_entry_header(&it)->nameHash);
+	}
+	memcpy(output + totalSize - sizeof(zpak_footer_t), &footer, sizeof(zpak_footer_t));
+	*data = output;
+	return totalSize;
 }
 
 int zpak_read(zpak_t *ctx, const char *entryName, void **data)
@@ -250,16 +950,144 @@ int zpak_read(zpak_t *ctx, const char *entryName, void **data)
 	ASSERT(entryName && entryName[0], "entry name should not be an emptry string");
 	const void *blob = GET_ZPAK_BLOB(ctx);
 	ASSERT(blob, "cannot read empty zpak blob");
-	zpak_it_t *it = zpak_it_construct(ctx);
-	uint64_t entryNameHash = __hash_string((const uint8_t*)entryName);
-	while (zpak_it_next(it))
+	uint32_t nameLength;
+	uint64_t nameHash = __hash_name(ctx, entryName, &nameLength);
+	uint32_t offset = __find_entry(ctx, entryName, nameLength, nameHash);
+	if (!offset)
+		return 0;
+	return zpak_handle_read(ctx, offset, data);
+}
+
+zpak_handle_t zpak_find(zpak_t *ctx, const char *entryName)
+{
+	if (!entryName || !entryName[0])
 	{
-		const zpak_entry_header_t *entryHeader = __it_get_entry_header(it);
-		if (entryHeader->nameHash == entryNameHash)
-			return __it_read_and_destruct(it, data);
+		__set_error(ctx, "entry name should not be an emptry string");
+		return 0;
 	}
-	zpak_it_destruct(it);
-	return 0;
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	if (!blob)
+	{
+		__set_error(ctx, "cannot read empty zpak blob");
+		return 0;
+	}
+	uint32_t nameLength;
+	uint64_t nameHash = __hash_name(ctx, entryName, &nameLength);
+	return __find_entry(ctx, entryName, nameLength, nameHash);
+}
+
+int zpak_handle_size(zpak_t *ctx, zpak_handle_t handle)
+{
+	ASSERT(__is_valid_handle(ctx, handle), "invalid entry handle");
+	zpak_it_t it = __it_at(ctx, handle);
+	return zpak_it_get_entry_size(&it);
+}
+
+int zpak_handle_read(zpak_t *ctx, zpak_handle_t handle, void **data)
+{
+	ASSERT(__is_valid_handle(ctx, handle), "invalid entry handle");
+	zpak_it_t it = __it_at(ctx, handle);
+	return zpak_it_read(&it, data);
+}
+
+int zpak_handle_read_buf(zpak_t *ctx, zpak_handle_t handle, void *data, int size)
+{
+	ASSERT(__is_valid_handle(ctx, handle), "invalid entry handle");
+	zpak_it_t it = __it_at(ctx, handle);
+	return zpak_it_read_buf(&it, data, size);
+}
+
+// checks that handle points at entry header within the blob entries
+static int __is_valid_handle(zpak_t *ctx, zpak_handle_t handle)
+{
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	return blob && handle >= ctx->entriesStart && 
+		(uint64_t)handle + sizeof(zpak_entry_header_t) <= ctx->curSize;
+}
+
+int zpak_read_many(zpak_t *ctx, const char **entryNames, int count, zpak_read_result_t *results, void **arena)
+{
+	ASSERT(count >= 0, "entry count should not be negative");
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot read empty zpak blob");
+	*arena = NULL;
+	if (count == 0)
+		return 0;
+	// name hashes, followed by resolved entry offsets and name lengths
+	uint64_t *hashes = ctx->alloc(ctx->memctx, NULL, count * (sizeof(uint64_t) + sizeof(uint32_t) * 2));
+	ASSERT(hashes, "could not allocate lookup buffer");
+	uint32_t *offsets = (uint32_t*)(hashes + count);
+	uint32_t *nameLengths = offsets + count;
+	uint32_t slotCount;
+	const zpak_dir_slot_t *slots = __get_dir(ctx, &slotCount);
+	for (int i = 0; i < count; i++)
+	{
+		offsets[i] = 0;
+		results[i].data = NULL;
+		results[i].size = 0;
+		results[i].status = ZPAK_S_NOT_FOUND;
+		if (!entryNames[i] || !entryNames[i][0])
+		{
+			results[i].status = ZPAK_S_INVALID_NAME;
+			continue;
+		}
+		hashes[i] = __hash_name(ctx, entryNames[i], nameLengths + i);
+		if (slots)
+			PREFETCH(slots + __dir_slot_index(hashes[i], slotCount));
+	}
+	if (slots || ctx->mphSlots || ctx->hashesOffset)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (results[i].status != ZPAK_S_INVALID_NAME)
+				offsets[i] = __find_entry(ctx, entryNames[i], nameLengths[i], hashes[i]);
+		}
+	}
+	else
+	{
+		__resolve_many_by_scan(ctx, entryNames, nameLengths, hashes, results, offsets, count);
+	}
+	uint32_t arenaSize = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (!offsets[i])
+			continue;
+		zpak_it_t it = __it_at(ctx, offsets[i]);
+		arenaSize = ALIGN(arenaSize, ZPAK_DIR_ALIGN) + zpak_it_get_entry_size(&it);
+	}
+	uint8_t *output = NULL;
+	if (arenaSize)
+	{
+		output = ctx->alloc(ctx->memctx, NULL, arenaSize);
+		if (!output)
+		{
+			ctx->alloc(ctx->memctx, hashes, 0);
+			SET_ERROR("could not allocate output arena");
+		}
+	}
+	int found = 0;
+	uint32_t cursor = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (!offsets[i])
+			continue;
+		zpak_it_t it = __it_at(ctx, offsets[i]);
+		cursor = ALIGN(cursor, ZPAK_DIR_ALIGN);
+		int size = zpak_it_read_buf(&it, output + cursor, zpak_it_get_entry_size(&it));
+		if (size == -1)
+		{
+			results[i].status = ZPAK_S_CORRUPTED;
+			continue;
+		}
+		results[i].data = output + cursor;
+		results[i].size = size;
+		results[i].status = ZPAK_S_OK;
+		cursor += size;
+		found++;
+	}
+	ctx->alloc(ctx->memctx, hashes, 0);
+	*arena = output;
+	return found;
 }
 
 zpak_it_t* zpak_it_construct(zpak_t *ctx)
@@ -267,8 +1095,14 @@ zpak_it_t* zpak_it_construct(zpak_t *ctx)
 	zpak_it_t *it = ctx->alloc(ctx->memctx, NULL, sizeof(zpak_it_t));
 	if (!it) 
 		return NULL;
+	return zpak_it_init((zpak_it_storage_t*)it, ctx);
+}
+
+zpak_it_t* zpak_it_init(zpak_it_storage_t *storage, zpak_t *ctx)
+{
+	zpak_it_t *it = (zpak_it_t*)storage;
+	memset(it, 0, sizeof(zpak_it_t));
 	it->ctx = ctx;
-	it->current = 0;
 	return it;
 }
 
@@ -284,23 +1118,85 @@ int zpak_it_next(zpak_it_t *it)
 	const void *blob = GET_ZPAK_BLOB(it->ctx);
 	if (!blob)
 		return 0;
-	if (it->current >= it->ctx->bufSize)
-		return 0;
-	if (it->current == 0)
+	if (it->mode == ZI_PREFIX_RANGE)
 	{
-		it->current += sizeof(zpak_header_t);
+		if (it->rangeIndex >= it->rangeEnd)
+			return 0;
+		it->current = __get_name_records(it->ctx)[it->rangeIndex++].entryOffset;
+		return 1;
 	}
-	else
+	for (;;)
+	{
+		if (it->current >= it->ctx->bufSize)
+			return 0;
+		if (it->current == 0)
+		{
+			it->current += it->ctx->entriesStart;
+		}
+		else
+		{
+			const uint8_t *cursor = (const uint8_t*)blob + it->current;
+			const zpak_entry_header_t *entry = (const zpak_entry_header_t*)cursor;
+			it->current += __calc_entry_size(entry);
+		}
+		if (it->current >= it->ctx->curSize)
+			return 0;
+		if (it->mode != ZI_PREFIX_SCAN || strncmp(zpak_it_get_entry_name(it), it->prefix, it->prefixLength) == 0)
+			return 1;
+	}
+}
+
+int zpak_list_prefix(zpak_t *ctx, const char *prefix, zpak_it_t *it)
+{
+	ASSERT(prefix, "prefix should not be NULL");
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot list empty zpak blob");
+	it->ctx = ctx;
+	it->current = 0;
+	it->prefix = prefix;
+	it->prefixLength = strlen(prefix);
+	if (!ctx->namesOffset)
 	{
-		const uint8_t *cursor = (const uint8_t*)blob + it->current;
-		const zpak_entry_header_t *entry = (const zpak_entry_header_t*)cursor;
-		it->current += __calc_entry_size(entry);
+		it->mode = ZI_PREFIX_SCAN;
+		zpak_it_t scan = __it_at(ctx, 0);
+		scan.mode = ZI_PREFIX_SCAN;
+		scan.prefix = prefix;
+		scan.prefixLength = it->prefixLength;
+		int count = 0;
+		while (zpak_it_next(&scan))
+			count++;
+		return count;
 	}
-	return it->current < it->ctx->curSize;
+	// names sharing the prefix form contiguous range in the sorted records
+	const zpak_name_record_t *records = __get_name_records(ctx);
+	uint32_t low = 0, high = ctx->namesCount;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (strcmp(__get_record_name(ctx, records + middle), prefix) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	it->rangeIndex = low;
+	high = ctx->namesCount;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (strncmp(__get_record_name(ctx, records + middle), prefix, it->prefixLength) == 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	it->rangeEnd = low;
+	it->mode = ZI_PREFIX_RANGE;
+	return it->rangeEnd - it->rangeIndex;
 }
 
 int zpak_it_get_entry_size(zpak_it_t *it)
 {
+	if (it->mode == ZI_PREFIX_RANGE)
+		return __get_name_records(it->ctx)[it->rangeIndex - 1].size;
 	const void *blob = GET_ZPAK_BLOB(it->ctx);
 	const uint8_t *cursor = (const uint8_t*)blob + it->current;
 	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)cursor;
@@ -309,12 +1205,24 @@ int zpak_it_get_entry_size(zpak_it_t *it)
 
 const char* zpak_it_get_entry_name(zpak_it_t *it)
 {
+	if (it->mode == ZI_PREFIX_RANGE)
+		return __get_record_name(it->ctx, __get_name_records(it->ctx) + it->rangeIndex - 1);
 	const void *blob = GET_ZPAK_BLOB(it->ctx);
 	const uint8_t *cursor = (const uint8_t*)blob + it->current;
 	cursor += sizeof(zpak_entry_header_t);
 	return (const char*)cursor;
 }
 
+// entry iterator positioned at offset, 0 is before the first entry
+static zpak_it_t __it_at(zpak_t *ctx, uint32_t offset)
+{
+	zpak_it_t it;
+	memset(&it, 0, sizeof(zpak_it_t));
+	it.ctx = ctx;
+	it.current = offset;
+	return it;
+}
+
 static const zpak_entry_header_t* __it_get_entry_header(zpak_it_t *it) 
 {
 	const void *blob = GET_ZPAK_BLOB(it->ctx);
@@ -332,10 +1240,21 @@ int zpak_it_read(zpak_it_t *it, void **data)
 	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)cursor;
 	cursor += sizeof(zpak_entry_header_t) + entry->nameLength;
 	*data = ctx->alloc(ctx->memctx, NULL, entry->size);
-	if (ctx->flags & ZPAK_F_LZS)
-		lzs_decompress((uint8_t*)*data, entry->size, cursor, entry->compSize);
-	else
+	ASSERT(*data, "could not allocate entry buffer");
+	if (entry->flags & ZE_CHUNKED)
+	{
+		if (__read_range(ctx, entry, 0, entry->size, (uint8_t*)*data) == -1)
+		{
+			ctx->alloc(ctx->memctx, *data, 0);
+			*data = NULL;
+			return -1;
+		}
+		return entry->size;
+	}
+	if (__is_stored(ctx, entry))
 		memcpy(*data, cursor, entry->size);
+	else
+		__decompress(ctx, (uint8_t*)*data, entry->size, cursor, entry->compSize);
 	return entry->size;
 }
 
@@ -344,42 +1263,828 @@ int zpak_it_read_buf(zpak_it_t *it, void *data, int size)
 	zpak_t *ctx = it->ctx;
 	const void *blob = GET_ZPAK_BLOB(ctx);
 	ASSERT(blob, "cannot read empty zpak blob");
+	ASSERT(size >= 0, "buffer size should not be negative");
 	const uint8_t *cursor = (const uint8_t*)blob + it->current;
 	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)cursor;
 	cursor += sizeof(zpak_entry_header_t) + entry->nameLength;
-	if (ctx->flags & ZPAK_F_LZS)
-		lzs_decompress((uint8_t*)data, size, cursor, entry->compSize);
+	if (entry->flags & ZE_CHUNKED)
+	{
+		if (__read_range(ctx, entry, 0, M_MIN((uint32_t)size, entry->size), (uint8_t*)data) == -1)
+			return -1;
+	}
+	else if (__is_stored(ctx, entry))
+		memcpy(data, cursor, M_MIN((uint32_t)size, entry->size));
 	else
-		memcpy(data, cursor, entry->size);
+		__decompress(ctx, (uint8_t*)data, M_MIN((uint32_t)size, entry->size), cursor, entry->compSize);
 	return entry->size;
 }
 
-static uint32_t __it_read_and_destruct(zpak_it_t *it, void **data)
+int zpak_read_into(zpak_t *ctx, const char *entryName, void *data, int capacity)
 {
-	uint32_t size = zpak_it_read(it, data);
-	zpak_it_destruct(it);
-	return size;
+	ASSERT(entryName && entryName[0], "entry name should not be an emptry string");
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot read empty zpak blob");
+	uint32_t nameLength;
+	uint64_t nameHash = __hash_name(ctx, entryName, &nameLength);
+	uint32_t offset = __find_entry(ctx, entryName, nameLength, nameHash);
+	if (!offset)
+		return 0;
+	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)((const uint8_t*)blob + offset);
+	ASSERT(capacity >= 0 && entry->size <= (uint32_t)capacity, "buffer is too small for the entry");
+	zpak_it_t it = __it_at(ctx, offset);
+	return zpak_it_read_buf(&it, data, entry->size);
 }
 
-const char* zpak_get_last_error(zpak_t *ctx)
+int zpak_read_cached(zpak_t *ctx, const char *entryName, const void **data)
 {
-	return ctx->err;
+	ASSERT(entryName && entryName[0], "entry name should not be an emptry string");
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot read empty zpak blob");
+	*data = NULL;
+	uint32_t nameLength;
+	uint64_t nameHash = __hash_name(ctx, entryName, &nameLength);
+	uint32_t offset = __find_entry(ctx, entryName, nameLength, nameHash);
+	if (!offset)
+		return 0;
+	return __read_cached(ctx, offset, data);
 }
 
-void zpak_set_alloc_fn(zpak_t *ctx, zpak_alloc_fn allocator, void* memctx)
+// reads entry at resolved offset through the entry cache
+static int __read_cached(zpak_t *ctx, uint32_t offset, const void **data)
 {
-	if (allocator)
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	MUTEX_LOCK(&ctx->payloadLock);
+	zpak_payload_t *payload = __payload_find(ctx, offset);
+	if (payload)
 	{
-		ctx->alloc = allocator;
-		ctx->memctx = memctx;
+		payload->refs++;
+		payload->referenced = 1;
+		ctx->payloadHits++;
+		MUTEX_UNLOCK(&ctx->payloadLock);
+		*data = payload + 1;
+		return payload->size;
 	}
-	else
+	ctx->payloadMisses++;
+	MUTEX_UNLOCK(&ctx->payloadLock);
+	// decompressed without the lock, concurrent readers of the same entry may race to insert it
+	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)((const uint8_t*)blob + offset);
+	payload = ctx->alloc(ctx->memctx, NULL, sizeof(zpak_payload_t) + entry->size);
+	ASSERT(payload, "could not allocate entry cache payload");
+	payload->offset = 0;
+	payload->size = entry->size;
+	payload->refs = 1;
+	payload->referenced = 1;
+	zpak_it_t it = __it_at(ctx, offset);
+	if (zpak_it_read_buf(&it, payload + 1, entry->size) == -1)
 	{
-		ctx->alloc = __default_alloc;
-		ctx->memctx = NULL;
+		ctx->alloc(ctx->memctx, payload, 0);
+		return -1;
 	}
-}
-
+	MUTEX_LOCK(&ctx->payloadLock);
+	zpak_payload_t *cached = __payload_find(ctx, offset);
+	if (cached)
+	{
+		cached->refs++;
+		MUTEX_UNLOCK(&ctx->payloadLock);
+		ctx->alloc(ctx->memctx, payload, 0);
+		*data = cached + 1;
+		return cached->size;
+	}
+	if (payload->size <= ctx->payloadBudget)
+	{
+		__payload_evict(ctx, payload->size);
+		if (ctx->payloadMemory + payload->size <= ctx->payloadBudget)
+		{
+			payload->offset = offset;
+			if (__payload_insert(ctx, payload) == -1)
+				payload->offset = 0;
+		}
+	}
+	MUTEX_UNLOCK(&ctx->payloadLock);
+	*data = payload + 1;
+	return payload->size;
+}
+
+void zpak_release_cached(zpak_t *ctx, const void *data)
+{
+	if (!data)
+		return;
+	zpak_payload_t *payload = (zpak_payload_t*)data - 1;
+	MUTEX_LOCK(&ctx->payloadLock);
+	int drop = --payload->refs == 0 && !payload->offset;
+	MUTEX_UNLOCK(&ctx->payloadLock);
+	if (drop)
+		ctx->alloc(ctx->memctx, payload, 0);
+}
+
+int zpak_read_view(zpak_t *ctx, const char *entryName, const void **data)
+{
+	ASSERT(entryName && entryName[0], "entry name should not be an emptry string");
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot read empty zpak blob");
+	*data = NULL;
+	uint32_t nameLength;
+	uint64_t nameHash = __hash_name(ctx, entryName, &nameLength);
+	uint32_t offset = __find_entry(ctx, entryName, nameLength, nameHash);
+	if (!offset)
+		return 0;
+	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)((const uint8_t*)blob + offset);
+	if (!__is_stored(ctx, entry))
+		return __read_cached(ctx, offset, data);
+	// stored entry data is used in place, the blob is not moved by writes until the view is released
+	MUTEX_LOCK(&ctx->payloadLock);
+	ctx->viewCount++;
+	MUTEX_UNLOCK(&ctx->payloadLock);
+	*data = (const uint8_t*)(entry + 1) + entry->nameLength;
+	return entry->size;
+}
+
+void zpak_release_view(zpak_t *ctx, const void *data)
+{
+	if (!data)
+		return;
+	const uint8_t *blob = GET_ZPAK_BLOB(ctx);
+	if (blob && (const uint8_t*)data >= blob && (const uint8_t*)data < blob + ctx->curSize)
+	{
+		MUTEX_LOCK(&ctx->payloadLock);
+		ctx->viewCount--;
+		MUTEX_UNLOCK(&ctx->payloadLock);
+		return;
+	}
+	zpak_release_cached(ctx, data);
+}
+
+int zpak_read_range(zpak_t *ctx, const char *entryName, unsigned int offset, unsigned int length, void *data)
+{
+	ASSERT(entryName && entryName[0], "entry name should not be an emptry string");
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot read empty zpak blob");
+	zpak_handle_t handle = zpak_find(ctx, entryName);
+	if (!handle)
+		return 0;
+	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)((const uint8_t*)blob + handle);
+	ASSERT(offset <= entry->size, "range offset is out of entry bounds");
+	length = M_MIN(length, entry->size - offset);
+	if (!length)
+		return 0;
+	return __read_range(ctx, entry, offset, length, (uint8_t*)data);
+}
+
+zpak_entry_t* zpak_entry_open(zpak_t *ctx, const char *entryName)
+{
+	zpak_handle_t handle = zpak_find(ctx, entryName);
+	if (!handle)
+		return NULL;
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	const zpak_entry_header_t *entry = (const zpak_entry_header_t*)((const uint8_t*)blob + handle);
+	zpak_entry_t *reader = ctx->alloc(ctx->memctx, NULL, sizeof(zpak_entry_t));
+	if (!reader)
+	{
+		__set_error(ctx, "could not allocate entry reader");
+		return NULL;
+	}
+	reader->ctx = ctx;
+	reader->dataOffset = handle + sizeof(zpak_entry_header_t) + entry->nameLength;
+	reader->compSize = entry->compSize;
+	reader->consumed = 0;
+	reader->remaining = entry->size;
+	reader->streamEnd = entry->compSize;
+	reader->streamRemaining = entry->size;
+	reader->blockSize = 0;
+	reader->blockCount = 0;
+	reader->blockIndex = 0;
+	reader->stored = __is_stored(ctx, entry);
+	if (entry->flags & ZE_CHUNKED)
+	{
+		// blocks are started on read
+		zpak_chunk_header_t chunk;
+		uint64_t headerSize = UINT64_MAX;
+		if (entry->compSize >= sizeof(zpak_chunk_header_t))
+		{
+			memcpy(&chunk, (const uint8_t*)blob + reader->dataOffset, sizeof(zpak_chunk_header_t));
+			headerSize = sizeof(zpak_chunk_header_t) + ((uint64_t)chunk.blockCount + 1) * sizeof(uint32_t);
+		}
+		if (headerSize > entry->compSize)
+		{
+			ctx->alloc(ctx->memctx, reader, 0);
+			__set_error(ctx, "corrupted entry seek table");
+			return NULL;
+		}
+		reader->tableOffset = reader->dataOffset + sizeof(zpak_chunk_header_t);
+		reader->dataOffset += (uint32_t)headerSize;
+		reader->compSize = entry->compSize - (uint32_t)headerSize;
+		reader->streamRemaining = 0;
+		reader->blockSize = chunk.blockSize;
+		reader->blockCount = chunk.blockCount;
+	}
+	lzs_decompress_init(&reader->lzs);
+	return reader;
+}
+
+int zpak_entry_read(zpak_entry_t *reader, void *data, int size)
+{
+	zpak_t *ctx = reader->ctx;
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot read empty zpak blob");
+	ASSERT(size >= 0, "buffer size should not be negative");
+	uint32_t total = M_MIN((uint32_t)size, reader->remaining);
+	uint8_t *output = (uint8_t*)data;
+	for (uint32_t done = 0; done < total;)
+	{
+		if (!reader->streamRemaining && __entry_next_block(reader) == -1)
+			return -1;
+		uint32_t chunk = M_MIN(total - done, reader->streamRemaining);
+		const uint8_t *compData = (const uint8_t*)blob + reader->dataOffset + reader->consumed;
+		if (reader->stored)
+		{
+			memcpy(output + done, compData, chunk);
+			reader->consumed += chunk;
+		}
+		else
+		{
+			reader->lzs.inPtr = compData;
+			reader->lzs.inLength = reader->streamEnd - reader->consumed;
+			reader->lzs.outPtr = output + done;
+			reader->lzs.outLength = chunk;
+			size_t produced = lzs_decompress_incremental(&reader->lzs);
+			reader->consumed = reader->streamEnd - (uint32_t)reader->lzs.inLength;
+			ASSERT(!(reader->lzs.status & LZS_D_STATUS_ERROR), "corrupted entry data");
+			ASSERT(produced == chunk, "entry data ended before its decompressed size");
+		}
+		done += chunk;
+		reader->remaining -= chunk;
+		reader->streamRemaining -= chunk;
+	}
+	return total;
+}
+
+void zpak_entry_close(zpak_entry_t *reader)
+{
+	if (!reader)
+		return;
+	reader->ctx->alloc(reader->ctx->memctx, reader, 0);
+}
+
+// starts next lzs stream of chunked entry
+static int __entry_next_block(zpak_entry_t *reader)
+{
+	zpak_t *ctx = reader->ctx;
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	const uint8_t *table = (const uint8_t*)blob + reader->tableOffset + reader->blockIndex * sizeof(uint32_t);
+	ASSERT(reader->blockSize && reader->blockIndex < reader->blockCount, "corrupted entry data");
+	reader->consumed = __read32(table);
+	reader->streamEnd = __read32(table + sizeof(uint32_t));
+	ASSERT(reader->consumed <= reader->streamEnd && reader->streamEnd <= reader->compSize, "corrupted entry seek table");
+	reader->streamRemaining = M_MIN(reader->blockSize, reader->remaining);
+	reader->blockIndex++;
+	lzs_decompress_init(&reader->lzs);
+	return 0;
+}
+
+int zpak_verify(zpak_t *ctx)
+{
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	ASSERT(blob, "cannot verify empty zpak blob");
+	const uint8_t *base = (const uint8_t*)blob;
+	uint32_t count = 0;
+	uint32_t cursor = ctx->entriesStart;
+	while (cursor < ctx->curSize)
+	{
+		ASSERT(ctx->curSize - cursor >= sizeof(zpak_entry_header_t), "zpak entry header is out of bounds");
+		const zpak_entry_header_t *entry = (const zpak_entry_header_t*)(base + cursor);
+		ASSERT(entry->nameLength > 0 && 
+			(uint64_t)entry->nameLength + entry->compSize <= ctx->curSize - cursor - sizeof(zpak_entry_header_t), "zpak entry is out of bounds");
+		ASSERT(entry->size <= INT32_MAX, "zpak entry is too large");
+		const char *name = (const char*)(entry + 1);
+		ASSERT(memchr(name, 0, entry->nameLength) == name + entry->nameLength - 1, "zpak entry name is malformed");
+		uint32_t nameLength;
+		ASSERT(__hash_name(ctx, name, &nameLength) == entry->nameHash, "zpak entry name hash does not match");
+		const uint8_t *data = (const uint8_t*)name + entry->nameLength;
+		ASSERT(!(entry->flags & ZE_STORED) || (ctx->flags & ZPAK_F_LZS && !(entry->flags & ZE_CHUNKED)), "zpak entry flags are malformed");
+		if (entry->flags & ZE_CHUNKED)
+		{
+			if (__verify_chunks(ctx, entry, data) == -1)
+				return -1;
+		}
+		else if (__is_stored(ctx, entry))
+		{
+			ASSERT(entry->compSize == entry->size, "zpak entry data is malformed");
+		}
+		else
+		{
+			ASSERT(lzs_decompress_validate(data, entry->compSize, entry->size), "zpak entry data is malformed");
+		}
+		cursor += __calc_entry_size(entry);
+		count++;
+	}
+	uint32_t *offsets = ctx->alloc(ctx->memctx, NULL, (count + 1) * sizeof(uint32_t));
+	ASSERT(offsets, "could not allocate verification buffer");
+	zpak_it_t it = __it_at(ctx, 0);
+	count = 0;
+	while (zpak_it_next(&it))
+		offsets[count++] = it.current;
+	int result = __verify_sections(ctx, offsets, count);
+	ctx->alloc(ctx->memctx, offsets, 0);
+	if (result == -1)
+		return -1;
+	ctx->opt |= ZO_VALIDATED;
+	return 0;
+}
+
+// checks that seek table covers entry size and all blocks are well-formed
+static int __verify_chunks(zpak_t *ctx, const zpak_entry_header_t *entry, const uint8_t *compData)
+{
+	zpak_chunk_header_t chunk;
+	ASSERT(ctx->flags & ZPAK_F_LZS && entry->compSize >= sizeof(zpak_chunk_header_t), "zpak entry data is malformed");
+	memcpy(&chunk, compData, sizeof(zpak_chunk_header_t));
+	ASSERT(chunk.blockSize && chunk.blockCount == (uint64_t)(entry->size + chunk.blockSize - 1) / chunk.blockSize, "zpak entry seek table is malformed");
+	uint64_t headerSize = sizeof(zpak_chunk_header_t) + ((uint64_t)chunk.blockCount + 1) * sizeof(uint32_t);
+	ASSERT(headerSize <= entry->compSize, "zpak entry seek table is malformed");
+	const uint8_t *table = compData + sizeof(zpak_chunk_header_t);
+	const uint8_t *blocks = compData + headerSize;
+	ASSERT(__read32(table) == 0 && __read32(table + chunk.blockCount * sizeof(uint32_t)) == entry->compSize - headerSize, "zpak entry seek table is malformed");
+	for (uint32_t b = 0; b < chunk.blockCount; b++)
+	{
+		uint32_t begin = __read32(table + b * sizeof(uint32_t));
+		uint32_t end = __read32(table + (b + 1) * sizeof(uint32_t));
+		uint32_t blockLength = M_MIN(chunk.blockSize, entry->size - b * chunk.blockSize);
+		ASSERT(begin <= end, "zpak entry seek table is malformed");
+		ASSERT(lzs_decompress_validate(blocks + begin, end - begin, blockLength), "zpak entry data is malformed");
+	}
+	return 0;
+}
+
+// checks that directories point at entry headers, offsets are sorted entry offsets
+static int __verify_sections(zpak_t *ctx, const uint32_t *offsets, uint32_t count)
+{
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	const uint8_t *base = (const uint8_t*)blob;
+	if (ctx->dirSlots)
+	{
+		const zpak_dir_slot_t *slots = (const zpak_dir_slot_t*)(base + ctx->dirOffset);
+		for (uint32_t i = 0; i < ctx->dirSlots; i++)
+		{
+			if (!slots[i].offset)
+				continue;
+			ASSERT(__is_entry_offset(offsets, count, slots[i].offset) && 
+				((const zpak_entry_header_t*)(base + slots[i].offset))->nameHash == slots[i].nameHash, "zpak directory is malformed");
+		}
+	}
+	if (ctx->mphSlots)
+	{
+		const uint32_t *mphOffsets = (const uint32_t*)(base + ctx->mphOffset + ALIGN(ctx->mphBuckets, 4));
+		for (uint32_t i = 0; i < ctx->mphSlots; i++)
+		{
+			ASSERT(!mphOffsets[i] || __is_entry_offset(offsets, count, mphOffsets[i]), "zpak perfect hash is malformed");
+		}
+	}
+	if (ctx->namesOffset)
+	{
+		const zpak_name_record_t *records = __get_name_records(ctx);
+		for (uint32_t i = 0; i < ctx->namesCount; i++)
+		{
+			ASSERT(__is_entry_offset(offsets, count, records[i].entryOffset) && records[i].nameOffset < ctx->namesSize &&
+				memchr(__get_record_name(ctx, records + i), 0, ctx->namesSize - records[i].nameOffset), "zpak name index is malformed");
+		}
+	}
+	if (ctx->hashesOffset)
+	{
+		ASSERT(ctx->entryCount == count, "zpak hash column is malformed");
+		const uint32_t *hashOffsets = (const uint32_t*)(base + ctx->hashesOffset + count * sizeof(uint64_t));
+		for (uint32_t i = 0; i < count; i++)
+		{
+			ASSERT(hashOffsets[i] == offsets[i], "zpak hash column is malformed");
+		}
+	}
+	return 0;
+}
+
+static int __is_entry_offset(const uint32_t *offsets, uint32_t count, uint32_t offset)
+{
+	uint32_t low = 0, high = count;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (offsets[middle] < offset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low < count && offsets[low] == offset;
+}
+
+// decompresses entry data, verified blobs skip malformed data checks
+static size_t __decompress(zpak_t *ctx, uint8_t *data, size_t size, const uint8_t *compData, size_t compSize)
+{
+	if (ctx->opt & ZO_VALIDATED)
+		return lzs_decompress_trusted(data, size, compData, compSize);
+	return lzs_decompress(data, size, compData, compSize);
+}
+
+// splits data into independently compressed blocks, returns compressed size with chunk header and seek table,
+// compData must hold chunk header, seek table and worst case sized slot per block
+static uint32_t __compress_chunked(zpak_t *ctx, uint8_t *compData, const uint8_t *data, uint32_t size)
+{
+	zpak_chunk_header_t chunk;
+	chunk.blockSize = ctx->chunkSize ? ctx->chunkSize : ZPAK_CHUNK_SIZE;
+	chunk.blockCount = (size - 1) / chunk.blockSize + 1;
+	memcpy(compData, &chunk, sizeof(zpak_chunk_header_t));
+	uint8_t *table = compData + sizeof(zpak_chunk_header_t);
+	uint32_t headerSize = sizeof(zpak_chunk_header_t) + (chunk.blockCount + 1) * sizeof(uint32_t);
+	uint8_t *blocks = compData + headerSize;
+	// blocks are compressed into slots of worst case size, possibly in parallel, seek table holds their sizes
+	zpak_block_job_t blockJob = { ctx, chunk.blockSize, size, 0, data, size, blocks, table, 0 };
+	zpak_job_t job = { __compress_block, &blockJob, chunk.blockCount, 0 };
+	__run_job(ctx, &job);
+	uint32_t cursor = 0;
+	for (uint32_t b = 0; b < chunk.blockCount; b++)
+	{
+		uint32_t blockCompSize = __read32(table + (b + 1) * sizeof(uint32_t));
+		memmove(blocks + cursor, blocks + b * ZPAK_BLOCK_BOUND(chunk.blockSize), blockCompSize);
+		memcpy(table + b * sizeof(uint32_t), &cursor, sizeof(uint32_t));
+		cursor += blockCompSize;
+	}
+	memcpy(table + chunk.blockCount * sizeof(uint32_t), &cursor, sizeof(uint32_t));
+	return headerSize + cursor;
+}
+
+// decompresses entry bytes [offset, offset + length), only blocks covering the range are decoded for chunked entry
+static int __read_range(zpak_t *ctx, const zpak_entry_header_t *entry, uint32_t offset, uint32_t length, uint8_t *data)
+{
+	const uint8_t *compData = (const uint8_t*)(entry + 1) + entry->nameLength;
+	if (__is_stored(ctx, entry))
+	{
+		memcpy(data, compData + offset, length);
+		return length;
+	}
+	if (!(entry->flags & ZE_CHUNKED))
+	{
+		// single lzs stream is decoded from the start
+		if (!offset)
+		{
+			__decompress(ctx, data, length, compData, entry->compSize);
+			return length;
+		}
+		uint8_t *temp = ctx->alloc(ctx->memctx, NULL, offset + length);
+		ASSERT(temp, "could not allocate decompression buffer");
+		__decompress(ctx, temp, offset + length, compData, entry->compSize);
+		memcpy(data, temp + offset, length);
+		ctx->alloc(ctx->memctx, temp, 0);
+		return length;
+	}
+	zpak_chunk_header_t chunk;
+	ASSERT(entry->compSize >= sizeof(zpak_chunk_header_t), "corrupted entry seek table");
+	memcpy(&chunk, compData, sizeof(zpak_chunk_header_t));
+	uint64_t headerSize = sizeof(zpak_chunk_header_t) + ((uint64_t)chunk.blockCount + 1) * sizeof(uint32_t);
+	ASSERT(chunk.blockSize && headerSize <= entry->compSize, "corrupted entry seek table");
+	const uint8_t *table = compData + sizeof(zpak_chunk_header_t);
+	const uint8_t *blocks = compData + headerSize;
+	uint32_t blocksSize = entry->compSize - (uint32_t)headerSize;
+	uint32_t rangeEnd = offset + length;
+	uint32_t lastBlock = (rangeEnd - 1) / chunk.blockSize;
+	ASSERT(lastBlock < chunk.blockCount, "corrupted entry seek table");
+	uint32_t firstBlock = offset / chunk.blockSize;
+	// fully covered blocks are decoded directly into the output, possibly in parallel
+	uint32_t firstFull = firstBlock + (offset % chunk.blockSize != 0);
+	uint32_t lastFull = lastBlock + (rangeEnd != entry->size && rangeEnd % chunk.blockSize != 0 ? 0 : 1);
+	if (lastFull > firstFull + 1)
+	{
+		zpak_block_job_t blockJob = { ctx, chunk.blockSize, entry->size, firstFull, blocks, blocksSize, 
+			data + firstFull * chunk.blockSize - offset, (uint8_t*)table, 0 };
+		zpak_job_t job = { __decompress_block, &blockJob, lastFull - firstFull, 0 };
+		__run_job(ctx, &job);
+		ASSERT(!blockJob.failed, "corrupted entry seek table");
+	}
+	else
+	{
+		firstFull = lastFull;
+	}
+	uint8_t *temp = NULL; // partially covered blocks
+	int result = length;
+	for (uint32_t b = firstBlock; b <= lastBlock; b++)
+	{
+		if (b >= firstFull && b < lastFull)
+			continue;
+		uint32_t blockStart = b * chunk.blockSize;
+		uint32_t blockLength = M_MIN(chunk.blockSize, entry->size - blockStart);
+		uint32_t begin = __read32(table + b * sizeof(uint32_t));
+		uint32_t end = __read32(table + (b + 1) * sizeof(uint32_t));
+		uint32_t from = offset > blockStart ? offset - blockStart : 0;
+		uint32_t to = M_MIN(rangeEnd - blockStart, blockLength);
+		uint8_t *output = data + blockStart + from - offset;
+		if (end < begin || end > blocksSize)
+		{
+			__set_error(ctx, "corrupted entry seek table");
+			result = -1;
+			break;
+		}
+		if (from == 0 && to == blockLength)
+		{
+			__decompress(ctx, output, blockLength, blocks + begin, end - begin);
+			continue;
+		}
+		if (!temp)
+			temp = ctx->alloc(ctx->memctx, NULL, chunk.blockSize);
+		if (!temp)
+		{
+			__set_error(ctx, "could not allocate decompression buffer");
+			result = -1;
+			break;
+		}
+		__decompress(ctx, temp, blockLength, blocks + begin, end - begin);
+		memcpy(output, temp + from, to - from);
+	}
+	if (temp)
+		ctx->alloc(ctx->memctx, temp, 0);
+	return result;
+}
+
+static void __compress_block(void *arg, uint32_t index)
+{
+	zpak_block_job_t *job = (zpak_block_job_t*)arg;
+	uint32_t blockStart = index * job->blockSize;
+	uint32_t blockLength = M_MIN(job->blockSize, job->size - blockStart);
+	uint32_t slotSize = ZPAK_BLOCK_BOUND(job->blockSize);
+	uint32_t blockCompSize = lzs_compress_level(job->output + index * slotSize, slotSize, job->input + blockStart, blockLength, job->ctx->level);
+	memcpy(job->table + (index + 1) * sizeof(uint32_t), &blockCompSize, sizeof(uint32_t));
+}
+
+// decodes block firstBlock + index into output
+static void __decompress_block(void *arg, uint32_t index)
+{
+	zpak_block_job_t *job = (zpak_block_job_t*)arg;
+	uint32_t b = job->firstBlock + index;
+	uint32_t blockLength = M_MIN(job->blockSize, job->size - b * job->blockSize);
+	uint32_t begin = __read32(job->table + b * sizeof(uint32_t));
+	uint32_t end = __read32(job->table + (b + 1) * sizeof(uint32_t));
+	if (end < begin || end > job->inputSize)
+	{
+		ATOMIC_NEXT(&job->failed);
+		return;
+	}
+	__decompress(job->ctx, job->output + index * job->blockSize, blockLength, job->input + begin, end - begin);
+}
+
+static void __work_job(zpak_job_t *job)
+{
+	uint32_t index;
+	while ((index = ATOMIC_NEXT(&job->next)) < job->count)
+		job->run(job->arg, index);
+}
+
+#ifdef ZPAK_THREADS
+	#ifdef _WIN32
+		static DWORD WINAPI __job_worker(LPVOID arg)
+		{
+			__work_job((zpak_job_t*)arg);
+			return 0;
+		}
+	#else
+		static void* __job_worker(void *arg)
+		{
+			__work_job((zpak_job_t*)arg);
+			return NULL;
+		}
+	#endif
+#endif
+
+// runs job items on worker threads and the calling thread, falls back to the calling thread alone
+static void __run_job(zpak_t *ctx, zpak_job_t *job)
+{
+#ifdef ZPAK_THREADS
+	uint32_t threadCount = __get_thread_count(ctx);
+	threadCount = M_MIN(threadCount, job->count);
+	#ifdef _WIN32
+		HANDLE threads[ZPAK_MAX_THREADS];
+	#else
+		pthread_t threads[ZPAK_MAX_THREADS];
+	#endif
+	uint32_t started = 0;
+	for (; started + 1 < threadCount; started++)
+	{
+	#ifdef _WIN32
+		threads[started] = CreateThread(NULL, 0, __job_worker, job, 0, NULL);
+		if (!threads[started])
+			break;
+	#else
+		if (pthread_create(threads + started, NULL, __job_worker, job) != 0)
+			break;
+	#endif
+	}
+	__work_job(job);
+	for (uint32_t t = 0; t < started; t++)
+	{
+	#ifdef _WIN32
+		WaitForSingleObject(threads[t], INFINITE);
+		CloseHandle(threads[t]);
+	#else
+		pthread_join(threads[t], NULL);
+	#endif
+	}
+#else
+	(void)ctx;
+	__work_job(job);
+#endif
+}
+
+#ifdef ZPAK_THREADS
+static uint32_t __get_thread_count(zpak_t *ctx)
+{
+	uint32_t threads = ctx->threads;
+	if (!threads)
+	{
+	#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		threads = info.dwNumberOfProcessors;
+	#else
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 0 ? (uint32_t)cores : 1;
+	#endif
+	}
+	return M_MIN(threads, ZPAK_MAX_THREADS);
+}
+#endif
+
+// resolves all requested hashes in a single walk over the entry headers
+static void __resolve_many_by_scan(zpak_t *ctx, const char **entryNames, const uint32_t *nameLengths, const uint64_t *hashes, zpak_read_result_t *results, uint32_t *offsets, int count)
+{
+	uint32_t slotCount = __calc_dir_slots(count);
+	uint32_t tableSize = slotCount * sizeof(zpak_request_slot_t) + count * sizeof(int);
+	zpak_request_slot_t *slots = ctx->alloc(ctx->memctx, NULL, tableSize);
+	if (!slots)
+	{
+		// fallback to the scan per request
+		for (int i = 0; i < count; i++)
+		{
+			if (results[i].status != ZPAK_S_INVALID_NAME)
+				offsets[i] = __find_entry(ctx, entryNames[i], nameLengths[i], hashes[i]);
+		}
+		return;
+	}
+	for (uint32_t s = 0; s < slotCount; s++)
+		slots[s].head = -1;
+	int *next = (int*)(slots + slotCount); // chains requests of the same name hash
+	int pending = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (results[i].status == ZPAK_S_INVALID_NAME)
+			continue;
+		if (!__may_contain(ctx, hashes[i]))
+		{
+			ATOMIC_NEXT(&ctx->bloomRejects);
+			continue;
+		}
+		uint32_t s = __dir_slot_index(hashes[i], slotCount);
+		while (slots[s].head != -1 && slots[s].nameHash != hashes[i])
+			s = (s + 1) & (slotCount - 1);
+		if (slots[s].head == -1)
+			slots[s].pending = 0;
+		next[i] = slots[s].head;
+		slots[s].nameHash = hashes[i];
+		slots[s].head = i;
+		slots[s].pending++;
+		pending++;
+	}
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	zpak_it_t it = __it_at(ctx, 0);
+	while (pending && zpak_it_next(&it))
+	{
+		const zpak_entry_header_t *entry = __it_get_entry_header(&it);
+		PREFETCH((const uint8_t*)blob + it.current + __calc_entry_size(entry));
+		uint32_t s = __dir_slot_index(entry->nameHash, slotCount);
+		while (slots[s].head != -1 && slots[s].nameHash != entry->nameHash)
+			s = (s + 1) & (slotCount - 1);
+		if (slots[s].head == -1 || !slots[s].pending)
+			continue;
+		// first entry wins, same as the linear scan, names are verified against hash collisions
+		for (int i = slots[s].head; i != -1; i = next[i])
+		{
+			if (offsets[i] || !__match_entry_name(entry, entryNames[i], nameLengths[i]))
+				continue;
+			offsets[i] = it.current;
+			slots[s].pending--;
+			pending--;
+		}
+	}
+	ctx->alloc(ctx->memctx, slots, 0);
+}
+
+void zpak_set_lazy_index(zpak_t *ctx, int enable)
+{
+	if (enable)
+	{
+		ctx->opt |= ZO_LAZY_INDEX;
+	}
+	else
+	{
+		ctx->opt &= ~ZO_LAZY_INDEX;
+		__free_index(ctx);
+	}
+}
+
+int zpak_set_bloom_bits(zpak_t *ctx, int bitsPerEntry)
+{
+	ASSERT(bitsPerEntry > 0 && bitsPerEntry <= 64, "bloom filter bits per entry should be in 1..64 range");
+	ctx->bloomBits = bitsPerEntry;
+	return 0;
+}
+
+int zpak_set_chunk_size(zpak_t *ctx, int size)
+{
+	ASSERT(size > 0, "chunk size should be positive");
+	ctx->chunkSize = size;
+	return 0;
+}
+
+int zpak_set_threads(zpak_t *ctx, int threads)
+{
+	ASSERT(threads >= 0, "thread count should not be negative");
+	ctx->threads = threads;
+	return 0;
+}
+
+int zpak_set_level(zpak_t *ctx, int level)
+{
+	ASSERT(level >= (int)LZS_LEVEL_MIN && level <= (int)LZS_LEVEL_MAX, "compression level should be in 0..9 range");
+	ctx->level = level;
+	return 0;
+}
+
+int zpak_set_entry_cache(zpak_t *ctx, int budget)
+{
+	ASSERT(budget >= 0, "entry cache budget should not be negative");
+	__clear_entry_cache(ctx);
+	ctx->payloadBudget = budget;
+	ctx->payloadHits = 0;
+	ctx->payloadMisses = 0;
+	ctx->payloadEvictions = 0;
+	return 0;
+}
+
+int zpak_set_lookup_cache(zpak_t *ctx, int slots)
+{
+	ASSERT(slots >= 0, "lookup cache slot count should not be negative");
+	if (ctx->cache)
+		ctx->alloc(ctx->memctx, ctx->cache, 0);
+	ctx->cache = NULL;
+	ctx->cacheSets = 0;
+	ctx->cacheHits = 0;
+	ctx->cacheMisses = 0;
+	if (!slots)
+		return 0;
+	uint32_t sets = 1;
+	while (sets * ZPAK_CACHE_WAYS < (uint32_t)slots)
+		sets <<= 1;
+	ctx->cache = ctx->alloc(ctx->memctx, NULL, sets * (ZPAK_CACHE_WAYS * sizeof(zpak_cache_slot_t) + 1));
+	ASSERT(ctx->cache, "could not allocate lookup cache");
+	ctx->cacheSets = sets;
+	__clear_lookup_cache(ctx);
+	return 0;
+}
+
+void zpak_get_stats(zpak_t *ctx, zpak_stats_t *stats)
+{
+	memset(stats, 0, sizeof(zpak_stats_t));
+	stats->indexMemory = ctx->indexSlots * sizeof(zpak_dir_slot_t);
+	MUTEX_LOCK(&ctx->cacheLock);
+	stats->cacheHits = ctx->cacheHits;
+	stats->cacheMisses = ctx->cacheMisses;
+	MUTEX_UNLOCK(&ctx->cacheLock);
+	stats->bloomRejects = ctx->bloomRejects;
+	MUTEX_LOCK(&ctx->payloadLock);
+	stats->entryCacheMemory = ctx->payloadMemory;
+	stats->entryCacheHits = ctx->payloadHits;
+	stats->entryCacheMisses = ctx->payloadMisses;
+	stats->entryCacheEvictions = ctx->payloadEvictions;
+	MUTEX_UNLOCK(&ctx->payloadLock);
+}
+
+const char* zpak_get_last_error(zpak_t *ctx)
+{
+	return __errorCtxId == ctx->id ? __errorMessage : NULL;
+}
+
+static void __set_error(zpak_t *ctx, const char *message)
+{
+	__errorCtxId = ctx->id;
+	__errorMessage = message;
+}
+
+void zpak_set_alloc_fn(zpak_t *ctx, zpak_alloc_fn allocator, void* memctx)
+{
+	if (allocator)
+	{
+		ctx->alloc = allocator;
+		ctx->memctx = memctx;
+	}
+	else
+	{
+		ctx->alloc = __default_alloc;
+		ctx->memctx = NULL;
+	}
+}
+
 void zpak_set_logger_fn(zpak_t *ctx, zpak_logger_fn logger)
 {
 	if (logger)
@@ -412,11 +2117,23 @@ static void* __start_zpak(zpak_t *ctx)
 		return NULL;
 	zpak_header_t *header = (zpak_header_t *)ctx->data;
 	SET_STR(header->signature, "ZPAK")
-	header->compType = 0;
+	header->compType = ZC_NONE;
 	if (ctx->flags & ZPAK_F_LZS)
-		header->compType = 1;
-	header->version = ZPAK_VERSION;
-	ctx->curSize = sizeof(zpak_header_t);
+		header->compType = ZC_LZS; // raised when chunked or stored entries are committed
+	header->version = ZPAK_VERSION_V1;
+	if (ctx->flags & ZPAK_V2_FLAGS)
+		header->version = ZPAK_VERSION_V2;
+	ctx->hashType = ZH_DJB2;
+	ctx->entriesStart = ZPAK_HEADER_SIZE_V1;
+	if (ctx->flags & ZPAK_F_FAST_HASH)
+	{
+		header->version = ZPAK_VERSION_V3;
+		header->hashType = ZH_WORDS;
+		header->reserved = 0;
+		ctx->hashType = ZH_WORDS;
+		ctx->entriesStart = sizeof(zpak_header_t);
+	}
+	ctx->curSize = ctx->entriesStart;
 	ctx->bufSize = ZPAK_INIT_SIZE;
 	return ctx->data;
 }
@@ -434,6 +2151,748 @@ static void* __resize_zpak_buffer(zpak_t *ctx, uint32_t newSize)
 	return ctx->data;
 }
 
+static int __load_directory(zpak_t *ctx, const void *data, uint32_t size)
+{
+	const zpak_header_t *header = (const zpak_header_t*)data;
+	ctx->curSize = size;
+	ctx->entryCount = 0;
+	ctx->dirOffset = 0;
+	ctx->dirSlots = 0;
+	ctx->mphSlots = 0;
+	ctx->namesOffset = 0;
+	ctx->namesCount = 0;
+	ctx->hashesOffset = 0;
+	ctx->bloomOffset = 0;
+	ctx->opt &= ~ZO_VALIDATED;
+	ctx->hashType = ZH_DJB2;
+	ctx->entriesStart = ZPAK_HEADER_SIZE_V1;
+	__clear_lookup_cache(ctx);
+	__clear_entry_cache(ctx);
+	if (header->version >= ZPAK_VERSION_V3)
+	{
+		ASSERT(size >= sizeof(zpak_header_t), "data buffer is too small to be processed");
+		ASSERT(header->hashType <= ZH_WORDS, "unsupported zpak name hash type");
+		ctx->hashType = (zpak_hash_type_t)header->hashType;
+		ctx->entriesStart = sizeof(zpak_header_t);
+	}
+	if (header->version < ZPAK_VERSION_V2)
+		return 0;
+	ASSERT(size >= ctx->entriesStart + sizeof(zpak_footer_t), "data buffer is too small to contain zpak directory");
+	const zpak_footer_t *footer = (const zpak_footer_t*)((const uint8_t*)data + size - sizeof(zpak_footer_t));
+	uint64_t sectionsEnd = size - sizeof(zpak_footer_t);
+	ASSERT(strncmp(footer->signature, "ZDIR", 4) == 0, "zpak directory footer is missing");
+	ASSERT(footer->footerSize == sizeof(zpak_footer_t), "unsupported zpak directory footer");
+	ASSERT(footer->entriesSize >= ctx->entriesStart && footer->entriesSize <= sectionsEnd, "zpak entries are out of bounds");
+	if (footer->dirSlots)
+	{
+		ASSERT(footer->dirSlots > footer->entryCount && !(footer->dirSlots & (footer->dirSlots - 1)), "zpak directory has invalid slot count");
+		ASSERT(footer->dirOffset >= footer->entriesSize && 
+			(uint64_t)footer->dirOffset + (uint64_t)footer->dirSlots * sizeof(zpak_dir_slot_t) <= sectionsEnd, "zpak directory is out of bounds");
+	}
+	if (footer->mphSlots)
+	{
+		ASSERT(footer->mphBuckets > 0, "zpak perfect hash has invalid bucket count");
+		ASSERT(footer->mphOffset >= footer->entriesSize && 
+			(uint64_t)footer->mphOffset + ALIGN((uint64_t)footer->mphBuckets, 4) + (uint64_t)footer->mphSlots * sizeof(uint32_t) <= sectionsEnd, 
+			"zpak perfect hash is out of bounds");
+	}
+	if (footer->namesOffset)
+	{
+		ASSERT(footer->namesOffset >= footer->entriesSize && 
+			(uint64_t)footer->namesOffset + footer->namesSize <= sectionsEnd &&
+			(uint64_t)footer->namesCount * sizeof(zpak_name_record_t) <= footer->namesSize, "zpak name index is out of bounds");
+	}
+	if (footer->hashesOffset)
+	{
+		ASSERT(footer->hashesOffset >= footer->entriesSize && !(footer->hashesOffset & (ZPAK_DIR_ALIGN - 1)) &&
+			(uint64_t)footer->hashesOffset + (uint64_t)footer->entryCount * (sizeof(uint64_t) + sizeof(uint32_t)) <= sectionsEnd, 
+			"zpak hash column is out of bounds");
+	}
+	if (footer->bloomOffset)
+	{
+		ASSERT(footer->bloomBlocks > 0 && footer->bloomProbes > 0, "zpak bloom filter is empty");
+		ASSERT(footer->bloomOffset >= footer->entriesSize && !(footer->bloomOffset & (ZPAK_DIR_ALIGN - 1)) &&
+			(uint64_t)footer->bloomOffset + (uint64_t)footer->bloomBlocks * ZPAK_BLOOM_BLOCK_WORDS * sizeof(uint64_t) <= sectionsEnd, 
+			"zpak bloom filter is out of bounds");
+	}
+	ctx->curSize = footer->entriesSize;
+	ctx->entryCount = footer->entryCount;
+	ctx->dirOffset = footer->dirOffset;
+	ctx->dirSlots = footer->dirSlots;
+	ctx->mphSeed = footer->mphSeed;
+	ctx->mphOffset = footer->mphOffset;
+	ctx->mphBuckets = footer->mphBuckets;
+	ctx->mphSlots = footer->mphSlots;
+	ctx->namesOffset = footer->namesOffset;
+	ctx->namesCount = footer->namesCount;
+	ctx->namesSize = footer->namesSize;
+	ctx->hashesOffset = footer->hashesOffset;
+	ctx->bloomOffset = footer->bloomOffset;
+	ctx->bloomBlocks = footer->bloomBlocks;
+	ctx->bloomProbes = footer->bloomProbes;
+	if (ctx->bloomOffset)
+		ctx->flags |= ZPAK_F_BLOOM;
+	if (ctx->hashesOffset)
+		ctx->flags |= ZPAK_F_HASH_COLUMN;
+	if (ctx->namesOffset)
+		ctx->flags |= ZPAK_F_NAME_INDEX;
+	if (ctx->dirSlots)
+		ctx->flags |= ZPAK_F_DIRECTORY;
+	if (ctx->mphSlots)
+		ctx->flags |= ZPAK_F_PERFECT_HASH;
+	return 0;
+}
+
+// returns entry offset, 0 if the entry was not found
+static uint32_t __find_entry(zpak_t *ctx, const char *entryName, uint32_t nameLength, uint64_t entryNameHash)
+{
+	int hashSeen;
+	if (!ctx->cache)
+		return __lookup_entry(ctx, entryName, nameLength, entryNameHash, &hashSeen);
+	// cache is shared mutable state, concurrent readers serialize on it
+	MUTEX_LOCK(&ctx->cacheLock);
+	zpak_cache_slot_t *set = ctx->cache + (__dir_slot_index(entryNameHash, ctx->cacheSets) * ZPAK_CACHE_WAYS);
+	for (uint32_t way = 0; way < ZPAK_CACHE_WAYS; way++)
+	{
+		zpak_cache_slot_t *slot = set + way;
+		if (!slot->used || slot->nameHash != entryNameHash)
+			continue;
+		zpak_it_t it = __it_at(ctx, slot->offset);
+		// negative results are cached only when no entry has the hash
+		if (slot->offset && !__match_entry_name(__it_get_entry_header(&it), entryName, nameLength))
+			break; // hash collision, cached entry has another name
+		slot->referenced = 1;
+		ctx->cacheHits++;
+		uint32_t offset = slot->offset;
+		MUTEX_UNLOCK(&ctx->cacheLock);
+		return offset;
+	}
+	ctx->cacheMisses++;
+	MUTEX_UNLOCK(&ctx->cacheLock);
+	uint32_t offset = __lookup_entry(ctx, entryName, nameLength, entryNameHash, &hashSeen);
+	if (offset || !hashSeen)
+	{
+		MUTEX_LOCK(&ctx->cacheLock);
+		__cache_insert(ctx, entryNameHash, offset);
+		MUTEX_UNLOCK(&ctx->cacheLock);
+	}
+	return offset;
+}
+
+// inserts lookup result, evicts slot with clock algorithm
+static void __cache_insert(zpak_t *ctx, uint64_t nameHash, uint32_t offset)
+{
+	uint32_t set = __dir_slot_index(nameHash, ctx->cacheSets);
+	zpak_cache_slot_t *slots = ctx->cache + set * ZPAK_CACHE_WAYS;
+	uint8_t *hand = (uint8_t*)(ctx->cache + ctx->cacheSets * ZPAK_CACHE_WAYS) + set;
+	zpak_cache_slot_t *slot = NULL;
+	for (uint32_t way = 0; way < ZPAK_CACHE_WAYS; way++)
+	{
+		// replace colliding name, so a set holds single result per hash
+		if (!slots[way].used || slots[way].nameHash == nameHash)
+		{
+			slot = slots + way;
+			break;
+		}
+	}
+	while (!slot)
+	{
+		zpak_cache_slot_t *candidate = slots + *hand;
+		*hand = (*hand + 1) % ZPAK_CACHE_WAYS;
+		if (candidate->referenced)
+			candidate->referenced = 0;
+		else
+			slot = candidate;
+	}
+	slot->nameHash = nameHash;
+	slot->offset = offset;
+	slot->used = 1;
+	slot->referenced = 0;
+}
+
+static uint32_t __payload_slot_index(uint32_t offset, uint32_t slotCount)
+{
+	return (uint32_t)__mix64(offset) & (slotCount - 1);
+}
+
+static zpak_payload_t* __payload_find(zpak_t *ctx, uint32_t offset)
+{
+	if (!ctx->payloadSlots)
+		return NULL;
+	uint32_t mask = ctx->payloadSlots - 1;
+	for (uint32_t s = __payload_slot_index(offset, ctx->payloadSlots); ctx->payloads[s]; s = (s + 1) & mask)
+	{
+		if (ctx->payloads[s]->offset == offset)
+			return ctx->payloads[s];
+	}
+	return NULL;
+}
+
+// keeps table at most half full, grows it by rehashing
+static int __payload_insert(zpak_t *ctx, zpak_payload_t *payload)
+{
+	if ((ctx->payloadCount + 1) * 2 > ctx->payloadSlots)
+	{
+		uint32_t slotCount = ctx->payloadSlots ? ctx->payloadSlots * 2 : 16;
+		zpak_payload_t **slots = ctx->alloc(ctx->memctx, NULL, slotCount * sizeof(zpak_payload_t*));
+		if (!slots)
+			return -1;
+		memset(slots, 0, slotCount * sizeof(zpak_payload_t*));
+		for (uint32_t i = 0; i < ctx->payloadSlots; i++)
+		{
+			if (!ctx->payloads[i])
+				continue;
+			uint32_t s = __payload_slot_index(ctx->payloads[i]->offset, slotCount);
+			while (slots[s])
+				s = (s + 1) & (slotCount - 1);
+			slots[s] = ctx->payloads[i];
+		}
+		if (ctx->payloads)
+			ctx->alloc(ctx->memctx, ctx->payloads, 0);
+		ctx->payloads = slots;
+		ctx->payloadSlots = slotCount;
+		ctx->payloadHand = 0;
+	}
+	uint32_t mask = ctx->payloadSlots - 1;
+	uint32_t s = __payload_slot_index(payload->offset, ctx->payloadSlots);
+	while (ctx->payloads[s])
+		s = (s + 1) & mask;
+	ctx->payloads[s] = payload;
+	ctx->payloadCount++;
+	ctx->payloadMemory += payload->size;
+	return 0;
+}
+
+// removes payload from the table with backward shift, referenced payload is freed on the last release
+static void __payload_remove(zpak_t *ctx, uint32_t slot)
+{
+	zpak_payload_t *payload = ctx->payloads[slot];
+	ctx->payloadCount--;
+	ctx->payloadMemory -= payload->size;
+	payload->offset = 0;
+	if (!payload->refs)
+		ctx->alloc(ctx->memctx, payload, 0);
+	uint32_t mask = ctx->payloadSlots - 1;
+	uint32_t hole = slot;
+	for (uint32_t s = (slot + 1) & mask; ctx->payloads[s]; s = (s + 1) & mask)
+	{
+		uint32_t home = __payload_slot_index(ctx->payloads[s]->offset, ctx->payloadSlots);
+		// moves into the hole, unless its home slot lies cyclically in (hole, s]
+		if (((s - home) & mask) >= ((s - hole) & mask))
+		{
+			ctx->payloads[hole] = ctx->payloads[s];
+			hole = s;
+		}
+	}
+	ctx->payloads[hole] = NULL;
+}
+
+// clock eviction of released payloads, until size fits into the budget
+static void __payload_evict(zpak_t *ctx, uint32_t size)
+{
+	uint32_t steps = ctx->payloadSlots * 2;
+	while (ctx->payloadMemory + size > ctx->payloadBudget && steps--)
+	{
+		uint32_t hand = ctx->payloadHand;
+		zpak_payload_t *payload = ctx->payloads[hand];
+		ctx->payloadHand = (hand + 1) & (ctx->payloadSlots - 1);
+		if (!payload || payload->refs)
+			continue;
+		if (payload->referenced)
+		{
+			payload->referenced = 0;
+			continue;
+		}
+		__payload_remove(ctx, hand);
+		ctx->payloadEvictions++;
+		// backward shift may have moved next payload into the hand slot
+		ctx->payloadHand = hand;
+	}
+}
+
+static void __clear_entry_cache(zpak_t *ctx)
+{
+	MUTEX_LOCK(&ctx->payloadLock);
+	for (uint32_t i = 0; i < ctx->payloadSlots; i++)
+	{
+		zpak_payload_t *payload = ctx->payloads[i];
+		if (!payload)
+			continue;
+		payload->offset = 0;
+		if (!payload->refs)
+			ctx->alloc(ctx->memctx, payload, 0);
+	}
+	if (ctx->payloads)
+		ctx->alloc(ctx->memctx, ctx->payloads, 0);
+	ctx->payloads = NULL;
+	ctx->payloadSlots = 0;
+	ctx->payloadCount = 0;
+	ctx->payloadMemory = 0;
+	ctx->payloadHand = 0;
+	MUTEX_UNLOCK(&ctx->payloadLock);
+}
+
+static void __clear_lookup_cache(zpak_t *ctx)
+{
+	if (ctx->cache)
+		memset(ctx->cache, 0, ctx->cacheSets * (ZPAK_CACHE_WAYS * sizeof(zpak_cache_slot_t) + 1));
+}
+
+// hashSeen is set when any entry has the name hash, name mismatches are hash collisions
+static uint32_t __lookup_entry(zpak_t *ctx, const char *entryName, uint32_t nameLength, uint64_t entryNameHash, int *hashSeen)
+{
+	*hashSeen = 0;
+	if (!__may_contain(ctx, entryNameHash))
+	{
+		ATOMIC_NEXT(&ctx->bloomRejects);
+		return 0;
+	}
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	uint32_t offset;
+	uint32_t slotCount;
+	const zpak_dir_slot_t *slots;
+	if (ctx->mphSlots)
+	{
+		// perfect hash maps any name onto some slot
+		offset = __mph_find(ctx, blob, entryNameHash);
+		if (!offset || offset >= ctx->curSize)
+			return 0;
+		zpak_it_t it = __it_at(ctx, offset);
+		if (__it_get_entry_header(&it)->nameHash != entryNameHash)
+			return 0;
+	}
+	else if ((slots = __get_dir(ctx, &slotCount)))
+	{
+		offset = __dir_find(slots, slotCount, entryNameHash);
+		if (!offset)
+			return 0;
+	}
+	else if (ctx->hashesOffset)
+	{
+		const uint64_t *hashes = (const uint64_t*)((const uint8_t*)blob + ctx->hashesOffset);
+		const uint32_t *offsets = (const uint32_t*)(hashes + ctx->entryCount);
+		uint32_t index = 0;
+		while ((index += __scan_hashes(hashes + index, ctx->entryCount - index, entryNameHash)) < ctx->entryCount)
+		{
+			*hashSeen = 1;
+			zpak_it_t it = __it_at(ctx, offsets[index]);
+			if (__match_entry_name(__it_get_entry_header(&it), entryName, nameLength))
+				return offsets[index];
+			index++;
+		}
+		return 0;
+	}
+	else
+	{
+		return __scan_entries(ctx, entryName, nameLength, entryNameHash, hashSeen);
+	}
+	*hashSeen = 1;
+	zpak_it_t it = __it_at(ctx, offset);
+	if (__match_entry_name(__it_get_entry_header(&it), entryName, nameLength))
+		return offset;
+	// directories keep only the first entry of equal hashes, hash collision
+	return __scan_entries(ctx, entryName, nameLength, entryNameHash, hashSeen);
+}
+
+static uint32_t __scan_entries(zpak_t *ctx, const char *entryName, uint32_t nameLength, uint64_t entryNameHash, int *hashSeen)
+{
+	zpak_it_t it = __it_at(ctx, 0);
+	while (zpak_it_next(&it))
+	{
+		const zpak_entry_header_t *entryHeader = __it_get_entry_header(&it);
+		if (entryHeader->nameHash != entryNameHash)
+			continue;
+		*hashSeen = 1;
+		if (__match_entry_name(entryHeader, entryName, nameLength))
+			return it.current;
+	}
+	return 0;
+}
+
+// compares name length first, entry name length includes terminating zero
+static int __match_entry_name(const zpak_entry_header_t *entry, const char *name, uint32_t nameLength)
+{
+	return entry->nameLength == nameLength + 1 && memcmp(entry + 1, name, nameLength) == 0;
+}
+
+// bloom filter probes single block, 0 if the name hash is surely missing, callers count the rejects
+static int __may_contain(zpak_t *ctx, uint64_t nameHash)
+{
+	if (!ctx->bloomOffset)
+		return 1;
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	uint64_t mixed = __mix64(nameHash);
+	const uint64_t *block = (const uint64_t*)((const uint8_t*)blob + ctx->bloomOffset) + 
+		__fast_range((uint32_t)(mixed >> 32), ctx->bloomBlocks) * ZPAK_BLOOM_BLOCK_WORDS;
+	uint32_t h1 = (uint32_t)mixed;
+	uint32_t h2 = (uint32_t)(__mix64(mixed) >> 32) | 1;
+	for (uint32_t i = 0; i < ctx->bloomProbes; i++, h1 += h2)
+	{
+		uint32_t bit = h1 & (ZPAK_BLOOM_BLOCK_WORDS * 64 - 1);
+		if (!(block[bit >> 6] & (1ull << (bit & 63))))
+			return 0;
+	}
+	return 1;
+}
+
+static void __bloom_insert(uint64_t *blocks, uint32_t blockCount, uint32_t probes, uint64_t nameHash)
+{
+	uint64_t mixed = __mix64(nameHash);
+	uint64_t *block = blocks + __fast_range((uint32_t)(mixed >> 32), blockCount) * ZPAK_BLOOM_BLOCK_WORDS;
+	uint32_t h1 = (uint32_t)mixed;
+	uint32_t h2 = (uint32_t)(__mix64(mixed) >> 32) | 1;
+	for (uint32_t i = 0; i < probes; i++, h1 += h2)
+	{
+		uint32_t bit = h1 & (ZPAK_BLOOM_BLOCK_WORDS * 64 - 1);
+		block[bit >> 6] |= 1ull << (bit & 63);
+	}
+}
+
+// returns index of the first matching hash, count if there is no match
+static uint32_t __scan_hashes(const uint64_t *hashes, uint32_t count, uint64_t nameHash)
+{
+	uint32_t i = 0;
+#if defined(ZPAK_AVX2)
+	const __m256i needle = _mm256_set1_epi64x((long long)nameHash);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i a = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(hashes + i)), needle);
+		__m256i b = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(hashes + i + 4)), needle);
+		uint32_t mask = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(a)) | 
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#elif defined(ZPAK_SSE2)
+	const __m128i needle = _mm_set1_epi64x((long long)nameHash);
+	for (; i + 4 <= count; i += 4)
+	{
+		// no 64 bit compare in sse2, both 32 bit halves have to match
+		__m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(hashes + i)), needle);
+		__m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(hashes + i + 2)), needle);
+		a = _mm_and_si128(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+		b = _mm_and_si128(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)));
+		uint32_t mask = (uint32_t)_mm_movemask_pd(_mm_castsi128_pd(a)) | 
+			((uint32_t)_mm_movemask_pd(_mm_castsi128_pd(b)) << 2);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		if (hashes[i] == nameHash)
+			return i;
+	}
+	return count;
+}
+
+// returns loaded or lazily built directory, NULL if lookups have to scan the entries
+static const zpak_dir_slot_t* __get_dir(zpak_t *ctx, uint32_t *slotCount)
+{
+	if (ctx->dirSlots)
+	{
+		const void *blob = GET_ZPAK_BLOB(ctx);
+		*slotCount = ctx->dirSlots;
+		return (const zpak_dir_slot_t*)((const uint8_t*)blob + ctx->dirOffset);
+	}
+	if (!(ctx->opt & ZO_LAZY_INDEX))
+		return NULL;
+	zpak_dir_slot_t *index = ATOMIC_LOAD_PTR(&ctx->index);
+	if (!index && !(index = __build_index(ctx)))
+		return NULL;
+	*slotCount = ctx->indexSlots;
+	return index;
+}
+
+static uint32_t __dir_slot_index(uint64_t nameHash, uint32_t slotCount)
+{
+	// fibonacci hashing, spreads djb2 hashes of similar paths across the table
+	return (uint32_t)((nameHash * 0x9E3779B97F4A7C15ull) >> 32) & (slotCount - 1);
+}
+
+static uint32_t __dir_find(const zpak_dir_slot_t *slots, uint32_t slotCount, uint64_t nameHash)
+{
+	uint32_t i = __dir_slot_index(nameHash, slotCount);
+	while (slots[i].offset)
+	{
+		if (slots[i].nameHash == nameHash)
+			return slots[i].offset;
+		i = (i + 1) & (slotCount - 1);
+	}
+	return 0;
+}
+
+// first entry wins on duplicate hashes, same as the linear scan
+static uint32_t __dir_insert(zpak_dir_slot_t *slots, uint32_t slotCount, const zpak_entry_header_t *entry, uint32_t offset)
+{
+	uint32_t i = __dir_slot_index(entry->nameHash, slotCount);
+	while (slots[i].offset)
+	{
+		if (slots[i].nameHash == entry->nameHash)
+			return slots[i].offset;
+		i = (i + 1) & (slotCount - 1);
+	}
+	slots[i].nameHash = entry->nameHash;
+	slots[i].offset = offset;
+	slots[i].size = entry->size;
+	slots[i].compSize = entry->compSize;
+	return offset;
+}
+
+// keeps load factor under 2/3, always leaves at least one empty slot
+static uint32_t __calc_dir_slots(uint32_t entryCount)
+{
+	uint32_t slots = 1;
+	while (slots <= entryCount + (entryCount >> 1))
+		slots <<= 1;
+	return slots;
+}
+
+// walks the entries once, returns NULL if the index could not be allocated
+// builds index once, concurrent readers wait for the first one
+static zpak_dir_slot_t* __build_index(zpak_t *ctx)
+{
+	MUTEX_LOCK(&ctx->indexLock);
+	if (ctx->index)
+	{
+		MUTEX_UNLOCK(&ctx->indexLock);
+		return ctx->index;
+	}
+	zpak_it_t it = __it_at(ctx, 0);
+	uint32_t entryCount = 0;
+	while (zpak_it_next(&it))
+		entryCount++;
+	uint32_t slotCount = __calc_dir_slots(entryCount);
+	zpak_dir_slot_t *slots = ctx->alloc(ctx->memctx, NULL, slotCount * sizeof(zpak_dir_slot_t));
+	if (!slots)
+	{
+		MUTEX_UNLOCK(&ctx->indexLock);
+		return NULL;
+	}
+	memset(slots, 0, slotCount * sizeof(zpak_dir_slot_t));
+	it.current = 0;
+	while (zpak_it_next(&it))
+		__dir_insert(slots, slotCount, __it_get_entry_header(&it), it.current);
+	ctx->indexSlots = slotCount;
+	ATOMIC_STORE_PTR(&ctx->index, slots);
+	MUTEX_UNLOCK(&ctx->indexLock);
+	return slots;
+}
+
+static void __free_index(zpak_t *ctx)
+{
+	if (ctx->index)
+		ctx->alloc(ctx->memctx, ctx->index, 0);
+	ctx->index = NULL;
+	ctx->indexSlots = 0;
+}
+
+// splitmix64 finalizer
+static uint64_t __mix64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ull;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBull;
+	x ^= x >> 31;
+	return x;
+}
+
+// maps 32b value into [0, range) without division
+static uint32_t __fast_range(uint32_t value, uint32_t range)
+{
+	return (uint32_t)(((uint64_t)value * range) >> 32);
+}
+
+static uint32_t __mph_slot(uint64_t mixed, uint8_t pilot, uint64_t seed, uint32_t slots)
+{
+	return __fast_range((uint32_t)(mixed ^ __mix64(pilot + seed)), slots);
+}
+
+static uint32_t __mph_find(zpak_t *ctx, const void *blob, uint64_t nameHash)
+{
+	const uint8_t *pilots = (const uint8_t*)blob + ctx->mphOffset;
+	const uint32_t *offsets = (const uint32_t*)(pilots + ALIGN(ctx->mphBuckets, 4));
+	uint64_t mixed = __mix64(nameHash ^ ctx->mphSeed);
+	uint32_t bucket = __fast_range((uint32_t)(mixed >> 32), ctx->mphBuckets);
+	return offsets[__mph_slot(mixed, pilots[bucket], ctx->mphSeed, ctx->mphSlots)];
+}
+
+static int __compare_mph_keys(const void *a, const void *b)
+{
+	const zpak_mph_key_t *keyA = (const zpak_mph_key_t*)a;
+	const zpak_mph_key_t *keyB = (const zpak_mph_key_t*)b;
+	if (keyA->nameHash != keyB->nameHash)
+		return keyA->nameHash < keyB->nameHash ? -1 : 1;
+	return keyA->offset < keyB->offset ? -1 : keyA->offset > keyB->offset;
+}
+
+// places keys of the bucket into free slots, returns 0 if no pilot fits
+static int __mph_place_bucket(zpak_mph_t *mph, const zpak_mph_key_t *keys, const uint32_t *bucketKeys, uint32_t count, uint32_t bucket)
+{
+	for (uint32_t pilot = 0; pilot < ZPAK_MPH_PILOTS; pilot++)
+	{
+		uint32_t placed = 0;
+		for (; placed < count; placed++)
+		{
+			const zpak_mph_key_t *key = keys + bucketKeys[placed];
+			uint32_t slot = __mph_slot(key->mixed, (uint8_t)pilot, mph->seed, mph->slots);
+			if (mph->offsets[slot])
+				break;
+			mph->offsets[slot] = key->offset;
+		}
+		if (placed == count)
+		{
+			mph->pilots[bucket] = (uint8_t)pilot;
+			return 1;
+		}
+		// roll back partially placed bucket
+		while (placed--)
+		{
+			const zpak_mph_key_t *key = keys + bucketKeys[placed];
+			mph->offsets[__mph_slot(key->mixed, (uint8_t)pilot, mph->seed, mph->slots)] = 0;
+		}
+	}
+	return 0;
+}
+
+// builds perfect hash over unique entry name hashes (first entry wins, same as the linear scan)
+// buckets are placed from the largest one, slot table is oversized by 1/4 to keep pilot search short
+static int __build_mph(zpak_t *ctx, uint32_t entryCount, zpak_mph_t *mph)
+{
+	uint32_t scratchSize = entryCount * (sizeof(zpak_mph_key_t) + sizeof(uint32_t)) + 
+		(entryCount / ZPAK_MPH_BUCKET_SIZE + 2) * 2 * sizeof(uint32_t) + (entryCount + 2) * sizeof(uint32_t);
+	uint8_t *scratch = ctx->alloc(ctx->memctx, NULL, scratchSize);
+	if (!scratch)
+		return -1;
+	zpak_mph_key_t *keys = (zpak_mph_key_t*)scratch;
+	zpak_it_t it = __it_at(ctx, 0);
+	uint32_t count = 0;
+	while (zpak_it_next(&it) && count < entryCount)
+	{
+		keys[count].nameHash = __it_get_entry_header(&it)->nameHash;
+		keys[count].offset = it.current;
+		count++;
+	}
+	qsort(keys, count, sizeof(zpak_mph_key_t), __compare_mph_keys);
+	uint32_t unique = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (unique && keys[unique - 1].nameHash == keys[i].nameHash)
+			continue;
+		keys[unique++] = keys[i];
+	}
+	count = unique;
+	mph->buckets = count / ZPAK_MPH_BUCKET_SIZE + 1;
+	mph->slots = count + count / 4 + 1;
+	uint32_t *order = (uint32_t*)(keys + entryCount); // key indices grouped by bucket
+	uint32_t *bucketStart = order + entryCount; // [buckets + 1]
+	uint32_t *bucketOrder = bucketStart + mph->buckets + 1; // bucket indices by descending size
+	uint32_t *sizeStart = bucketOrder + mph->buckets; // [count + 2]
+	mph->pilots = ctx->alloc(ctx->memctx, NULL, mph->buckets);
+	mph->offsets = ctx->alloc(ctx->memctx, NULL, mph->slots * sizeof(uint32_t));
+	int result = -1;
+	for (uint32_t attempt = 0; mph->pilots && mph->offsets && attempt < ZPAK_MPH_ATTEMPTS; attempt++)
+	{
+		mph->seed = __mix64(attempt + 1);
+		memset(mph->pilots, 0, mph->buckets);
+		memset(mph->offsets, 0, mph->slots * sizeof(uint32_t));
+		// counting sort keys by bucket
+		memset(bucketStart, 0, (mph->buckets + 1) * sizeof(uint32_t));
+		for (uint32_t i = 0; i < count; i++)
+		{
+			keys[i].mixed = __mix64(keys[i].nameHash ^ mph->seed);
+			keys[i].bucket = __fast_range((uint32_t)(keys[i].mixed >> 32), mph->buckets);
+			bucketStart[keys[i].bucket + 1]++;
+		}
+		for (uint32_t b = 0; b < mph->buckets; b++)
+			bucketStart[b + 1] += bucketStart[b];
+		for (uint32_t i = 0; i < count; i++)
+			order[bucketStart[keys[i].bucket]++] = i;
+		for (uint32_t b = mph->buckets; b > 0; b--)
+			bucketStart[b] = bucketStart[b - 1];
+		bucketStart[0] = 0;
+		// counting sort buckets by descending size
+		memset(sizeStart, 0, (count + 2) * sizeof(uint32_t));
+		for (uint32_t b = 0; b < mph->buckets; b++)
+			sizeStart[count - (bucketStart[b + 1] - bucketStart[b]) + 1]++;
+		for (uint32_t i = 0; i <= count; i++)
+			sizeStart[i + 1] += sizeStart[i];
+		for (uint32_t b = 0; b < mph->buckets; b++)
+			bucketOrder[sizeStart[count - (bucketStart[b + 1] - bucketStart[b])]++] = b;
+		uint32_t b = 0;
+		for (; b < mph->buckets; b++)
+		{
+			uint32_t bucket = bucketOrder[b];
+			uint32_t size = bucketStart[bucket + 1] - bucketStart[bucket];
+			if (size && !__mph_place_bucket(mph, keys, order + bucketStart[bucket], size, bucket))
+				break;
+		}
+		if (b == mph->buckets)
+		{
+			result = 0;
+			break;
+		}
+	}
+	ctx->alloc(ctx->memctx, scratch, 0);
+	return result;
+}
+
+static int __compare_name_keys(const void *a, const void *b)
+{
+	const zpak_name_key_t *keyA = (const zpak_name_key_t*)a;
+	const zpak_name_key_t *keyB = (const zpak_name_key_t*)b;
+	int result = strcmp(keyA->name, keyB->name);
+	if (result)
+		return result;
+	return keyA->offset < keyB->offset ? -1 : keyA->offset > keyB->offset;
+}
+
+// returns entries sorted by name, namesSize receives name index section size
+static zpak_name_key_t* __build_name_index(zpak_t *ctx, uint32_t entryCount, uint32_t *namesSize)
+{
+	zpak_name_key_t *keys = ctx->alloc(ctx->memctx, NULL, (entryCount + 1) * sizeof(zpak_name_key_t));
+	if (!keys)
+		return NULL;
+	zpak_it_t it = __it_at(ctx, 0);
+	uint32_t count = 0;
+	*namesSize = entryCount * sizeof(zpak_name_record_t);
+	while (zpak_it_next(&it) && count < entryCount)
+	{
+		const zpak_entry_header_t *entry = __it_get_entry_header(&it);
+		keys[count].name = zpak_it_get_entry_name(&it);
+		keys[count].offset = it.current;
+		keys[count].size = entry->size;
+		keys[count].nameLength = entry->nameLength;
+		*namesSize += entry->nameLength;
+		count++;
+	}
+	qsort(keys, count, sizeof(zpak_name_key_t), __compare_name_keys);
+	return keys;
+}
+
+static const zpak_name_record_t* __get_name_records(zpak_t *ctx)
+{
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	return (const zpak_name_record_t*)((const uint8_t*)blob + ctx->namesOffset);
+}
+
+static const char* __get_record_name(zpak_t *ctx, const zpak_name_record_t *record)
+{
+	const void *blob = GET_ZPAK_BLOB(ctx);
+	return (const char*)blob + ctx->namesOffset + record->nameOffset;
+}
+
+static void __free_mph(zpak_t *ctx, zpak_mph_t *mph)
+{
+	if (mph->pilots)
+		ctx->alloc(ctx->memctx, mph->pilots, 0);
+	if (mph->offsets)
+		ctx->alloc(ctx->memctx, mph->offsets, 0);
+	mph->pilots = NULL;
+	mph->offsets = NULL;
+}
+
 static uint32_t __calc_entry_size(const zpak_entry_header_t *entry)
 {
 	uint32_t size = sizeof(zpak_entry_header_t);
@@ -443,6 +2902,72 @@ static uint32_t __calc_entry_size(const zpak_entry_header_t *entry)
 }
 
 
+// hashes name with archive hash type, nameLength receives name length without terminating zero
+static uint64_t __hash_name(zpak_t *ctx, const char *name, uint32_t *nameLength)
+{
+	*nameLength = strlen(name);
+	if (ctx->hashType == ZH_WORDS)
+		return __hash_words((const uint8_t*)name, *nameLength);
+	return __hash_string((const uint8_t*)name);
+}
+
+static uint64_t __mum(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	return lo ^ hi;
+#endif
+}
+
+static uint64_t __read64(const uint8_t *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint64_t __read32(const uint8_t *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+// wyhash style, consumes 16 bytes per round
+static uint64_t __hash_words(const uint8_t *str, uint32_t length)
+{
+	const uint64_t k0 = 0xa0761d6478bd642full, k1 = 0xe7037ed1a0b428dbull, k2 = 0x8ebc6af09c88c6e3ull;
+	uint64_t seed = k0 ^ __mum(k0 ^ length, k2);
+	uint32_t remaining = length;
+	uint64_t a = 0, b = 0;
+	for (; remaining > 16; remaining -= 16, str += 16)
+		seed = __mum(__read64(str) ^ k1, __read64(str + 8) ^ seed);
+	if (remaining >= 8)
+	{
+		a = __read64(str);
+		b = __read64(str + remaining - 8);
+	}
+	else if (remaining >= 4)
+	{
+		a = __read32(str);
+		b = __read32(str + remaining - 4);
+	}
+	else if (remaining > 0)
+	{
+		a = ((uint64_t)str[0] << 16) | ((uint64_t)str[remaining >> 1] << 8) | str[remaining - 1];
+	}
+	return __mum(k1 ^ length, __mum(a ^ k1, b ^ seed));
+}
+
 // djb2 string hashing algorithm
 static uint64_t __hash_string(const uint8_t *str)
 {
@@ -35,22 +35,115 @@
 	* Uses lzs compression, which suits great for textual data (70% compression rate).
 	* Provides only necessary functionality to read, write and walk entries.
 
+	As of version 2:
+	* Optionally appends hashed entry directory (see ZPAK_F_DIRECTORY), 
+	  version 1 blobs are still readable and are looked up by linear scan.
+	* Optionally appends perfect hash directory (see ZPAK_F_PERFECT_HASH).
+	* Optionally appends sorted name index (see ZPAK_F_NAME_INDEX).
+	* Optionally appends name hash column (see ZPAK_F_HASH_COLUMN).
+	* Optionally appends bloom filter (see ZPAK_F_BLOOM).
+
+	As of version 3:
+	* Header records name hash type, entry names can be hashed word at a time 
+	  (see ZPAK_F_FAST_HASH).
+	* Lookups verify entry names after hash hit, hash collisions are resolved.
+	* Large entries can be split into independently compressed blocks with 
+	  seek table (see ZPAK_F_CHUNKED), marked by entry flags, such blobs use 
+	  compression type 2.
+	* Entries of lzs blobs, which do not shrink, are stored uncompressed and 
+	  marked by entry flags, such blobs use compression type 3 (4 if chunked).
+
 	zpak binary blob structure:
 		header {
 			signature
 			version
 			compression
+			hashType (v3)
+			reserved (v3)
 		}
 		entry {
 			header {
 				size
 				compSize
+				nameHash
 				flags
 				nameLength
 			}
 			name 
 			data
+			// or chunked entry data
+			data {
+				blockSize
+				blockCount
+				blockOffset
+				...
+				block
+				...
+			}
+		}
+		// version 2 only
+		directory {
+			slot { 
+				nameHash
+				offset
+				size
+				compSize
+			}
+			...
+		}
+		perfect hash {
+			pilots
+			offsets
 		}
+		name index {
+			record {
+				nameOffset
+				entryOffset
+				size
+			}
+			...
+			names
+		}
+		hash column {
+			nameHash
+			...
+			offset
+			...
+		}
+		bloom filter {
+			block
+			...
+		}
+		footer {
+			mphSeed
+			entriesSize
+			entryCount
+			dirOffset
+			dirSlots
+			mphOffset
+			mphBuckets
+			mphSlots
+			namesOffset
+			namesCount
+			namesSize
+			hashesOffset
+			bloomOffset
+			bloomBlocks
+			bloomProbes
+			footerSize
+			signature
+		}
+
+	Thread safety:
+	* Reads of loaded blob (zpak_read, zpak_find, zpak_handle_*, 
+	  zpak_read_many, zpak_read_range, zpak_read_view, zpak_it_* with caller 
+	  owned iterators, zpak_entry_*) do not modify shared state and can be made 
+	  from any number of threads without locking, given thread-safe allocator.
+	* Lazy index (see zpak_set_lazy_index) is built once under a lock, 
+	  lookup cache (see zpak_set_lookup_cache), entry cache (see 
+	  zpak_set_entry_cache) and view count are guarded by locks, built with 
+	  ZPAK_THREADS.
+	* Writes, loads and setters must not run concurrently with any other call.
 
 	Todo: 
 	* add user header structure getter
@@ -73,6 +166,20 @@
 
 typedef struct zpak_s zpak_t;
 typedef struct zpak_it_s zpak_it_t;
+typedef struct zpak_entry_s zpak_entry_t;
+
+/**
+ * Iterator storage size, see zpak_it_init
+ */
+#define ZPAK_IT_SIZE 64
+
+/**
+ * Caller owned iterator storage, which can be placed on the stack
+ */
+typedef union {
+	void *align;
+	unsigned char data[ZPAK_IT_SIZE];
+} zpak_it_storage_t;
 
 typedef enum {
 	/**
@@ -88,11 +195,137 @@ typedef enum {
 	 */
 	ZPAK_F_RW    = 1 << 2,
 	/**
-	 * Use Lempel-Ziv-Stac compression
+	 * Use Lempel-Ziv-Stac compression, incompressible entries are stored as is
 	 */
 	ZPAK_F_LZS  = 1 << 3,
+	/**
+	 * Append hashed entry directory on zpak_write_end (zpak v2),
+	 * turning entry lookups into a single probe sequence
+	 */
+	ZPAK_F_DIRECTORY = 1 << 4,
+	/**
+	 * Append perfect hash directory on zpak_write_end (zpak v2), 
+	 * entry lookup then takes single hash evaluation and name verification, 
+	 * directory takes about 5.3 bytes per entry
+	 */
+	ZPAK_F_PERFECT_HASH = 1 << 5,
+	/**
+	 * Append sorted entry name index on zpak_write_end (zpak v2), 
+	 * used by zpak_list_prefix
+	 */
+	ZPAK_F_NAME_INDEX = 1 << 6,
+	/**
+	 * Append contiguous entry name hash column on zpak_write_end (zpak v2), 
+	 * scanned with simd instructions, when there is no directory
+	 */
+	ZPAK_F_HASH_COLUMN = 1 << 7,
+	/**
+	 * Hash entry names word at a time instead of byte at a time (zpak v3)
+	 */
+	ZPAK_F_FAST_HASH = 1 << 8,
+	/**
+	 * Append blocked bloom filter of entry name hashes on zpak_write_end (zpak v2), 
+	 * missing names are rejected without lookup (see zpak_set_bloom_bits)
+	 */
+	ZPAK_F_BLOOM = 1 << 9,
+	/**
+	 * Split large lzs entries into independently compressed blocks with seek table,
+	 * so that entry byte range is decoded without decoding preceding data 
+	 * (see zpak_read_range, zpak_set_chunk_size)
+	 */
+	ZPAK_F_CHUNKED = 1 << 10,
 } zpak_flags_t;
 
+/**
+ * Per entry status codes
+ */
+typedef enum {
+	ZPAK_S_OK = 0,
+	ZPAK_S_NOT_FOUND = 1,
+	ZPAK_S_INVALID_NAME = 2,
+	ZPAK_S_CORRUPTED = 3,
+} zpak_status_t;
+
+/**
+ * Entry passed to zpak_write_batch
+ */
+typedef struct {
+	/**
+	 * Entry name
+	 */
+	const char *name;
+	/**
+	 * Data to compress
+	 */
+	const void *data;
+	/**
+	 * Data size
+	 */
+	int size;
+} zpak_write_entry_t;
+
+/**
+ * Batched read result
+ */
+typedef struct {
+	/**
+	 * Decompressed data, points into the shared output arena
+	 */
+	void *data;
+	/**
+	 * Decompressed data size
+	 */
+	int size;
+	/**
+	 * Status code, see zpak_status_t
+	 */
+	int status;
+} zpak_read_result_t;
+
+/**
+ * Resolved entry handle, 0 is invalid handle. Handle stays valid until 
+ * another blob is loaded into zpak instance
+ */
+typedef unsigned int zpak_handle_t;
+
+/**
+ * Runtime statistics
+ */
+typedef struct {
+	/**
+	 * Memory used by the lazily built in-memory index, in bytes
+	 */
+	int indexMemory;
+	/**
+	 * Lookups resolved by the lookup cache
+	 */
+	int cacheHits;
+	/**
+	 * Lookups missed by the lookup cache
+	 */
+	int cacheMisses;
+	/**
+	 * Lookups rejected by the bloom filter
+	 */
+	int bloomRejects;
+	/**
+	 * Decompressed data held by the entry cache, in bytes
+	 */
+	int entryCacheMemory;
+	/**
+	 * Reads served by the entry cache
+	 */
+	int entryCacheHits;
+	/**
+	 * Reads, which decompressed the entry
+	 */
+	int entryCacheMisses;
+	/**
+	 * Entries evicted from the entry cache to fit the budget
+	 */
+	int entryCacheEvictions;
+} zpak_stats_t;
+
 /**
  * Custom allocator. When size is zero, the allocator should behave 
  * like free and return NULL. When size is not zero, the allocator 
@@ -147,10 +380,22 @@ int zpak_load_static_data(zpak_t *ctx, const void *data, unsigned int size);
  * @param entryName essentially file path set in the zpak
  * @param data data to compress
  * @param size data size
- * @return compressed size
+ * @return compressed size, equals size when entry is stored
  */
 int zpak_write(zpak_t *ctx, const char *entryName, const void *data, int size);
 
+/**
+ * Creates multiple entries in zpak. Entries are compressed on worker threads
+ * (see zpak_set_threads) and appended in the given order, the blob is the same
+ * as of zpak_write calls for each entry
+ * @param ctx
+ * @param entries
+ * @param count number of entries
+ * @param compSizes per entry compressed sizes, must hold count elements, can be NULL
+ * @return number of written entries, -1 on error
+ */
+int zpak_write_batch(zpak_t *ctx, const zpak_write_entry_t *entries, int count, int *compSizes);
+
 /**
  * Returns complete archive. User is responsible for freeing it up
  * @param ctx
@@ -168,6 +413,144 @@ int zpak_write_end(zpak_t *ctx, void **data);
  */
 int zpak_read(zpak_t *ctx, const char *entryName, void **data);
 
+/**
+ * Reads and decompresses multiple entries at once. Names are resolved in a single pass 
+ * and the data is decompressed into one contiguous arena, each entry is 8 bytes aligned. 
+ * User is responsible for freeing up the arena
+ * @param ctx
+ * @param entryNames
+ * @param count number of entry names
+ * @param results per entry results, must hold count elements
+ * @param arena output arena pointer, NULL if no entries were found
+ * @return number of found and successfully read entries, -1 on error
+ */
+int zpak_read_many(zpak_t *ctx, const char **entryNames, int count, zpak_read_result_t *results, void **arena);
+
+// handles
+
+/**
+ * Resolves entry name into handle, which can be cached by user to skip 
+ * repeated name lookups
+ * @param ctx
+ * @param entryName
+ * @return entry handle, 0 if entry was not found or on error
+ */
+zpak_handle_t zpak_find(zpak_t *ctx, const char *entryName);
+
+/**
+ * Gets entry's decompressed data size
+ * @param ctx
+ * @param handle entry handle
+ * @return decompressed size, -1 on error
+ */
+int zpak_handle_size(zpak_t *ctx, zpak_handle_t handle);
+
+/**
+ * Reads and decompresses entry data. User is responsible for freeing up the buffer
+ * @param ctx
+ * @param handle entry handle
+ * @param data decompressed data pointer
+ * @return decompressed size, -1 on error
+ */
+int zpak_handle_read(zpak_t *ctx, zpak_handle_t handle, void **data);
+
+/**
+ * Reads and decompresses entry data into user buffer
+ * @param ctx
+ * @param handle entry handle
+ * @param data user buffer
+ * @param size user buffer size
+ * @return decompressed size, -1 on error
+ */
+int zpak_handle_read_buf(zpak_t *ctx, zpak_handle_t handle, void *data, int size);
+
+/**
+ * Resolves and decompresses entry into user buffer without any allocations
+ * @param ctx
+ * @param entryName
+ * @param data user buffer
+ * @param capacity user buffer size, must hold the whole entry
+ * @return decompressed size, 0 if entry was not found, -1 on error or if the entry does not fit
+ */
+int zpak_read_into(zpak_t *ctx, const char *entryName, void *data, int capacity);
+
+/**
+ * Reads entry through the entry cache (see zpak_set_entry_cache), repeated reads 
+ * share the decompressed data. Returned data is read only and must be released 
+ * with zpak_release_cached before zpak is modified or destructed. Safe to call 
+ * from concurrent readers, when built with ZPAK_THREADS
+ * @param ctx
+ * @param entryName
+ * @param data read only data pointer
+ * @return decompressed size, 0 if entry was not found, -1 on error
+ */
+int zpak_read_cached(zpak_t *ctx, const char *entryName, const void **data);
+
+/**
+ * Releases data returned by zpak_read_cached
+ * @param ctx
+ * @param data data pointer, may be NULL
+ */
+void zpak_release_cached(zpak_t *ctx, const void *data);
+
+/**
+ * Reads entry without copying. Stored entries (written without ZPAK_F_LZS or 
+ * incompressible) point directly into the blob, entries cannot be written until 
+ * such views are released. Compressed entries are decompressed through zpak_read_cached. Returned data is 
+ * read only, may be unaligned and must be released with zpak_release_view
+ * @param ctx
+ * @param entryName
+ * @param data read only data pointer
+ * @return data size, 0 if entry was not found, -1 on error
+ */
+int zpak_read_view(zpak_t *ctx, const char *entryName, const void **data);
+
+/**
+ * Releases data returned by zpak_read_view
+ * @param ctx
+ * @param data data pointer, may be NULL
+ */
+void zpak_release_view(zpak_t *ctx, const void *data);
+
+/**
+ * Reads and decompresses entry byte range into user buffer. For chunked entries 
+ * (see ZPAK_F_CHUNKED) only the blocks covering the range are decoded, 
+ * otherwise entry is decoded from the start up to the range end
+ * @param ctx
+ * @param entryName
+ * @param offset range offset in the decompressed entry data
+ * @param length range length, clamped to the entry end
+ * @param data user buffer, must hold length bytes
+ * @return number of bytes read, 0 if entry was not found, -1 on error
+ */
+int zpak_read_range(zpak_t *ctx, const char *entryName, unsigned int offset, unsigned int length, void *data);
+
+// streaming
+
+/**
+ * Opens entry for sequential reading in chunks. Reader keeps only a small fixed 
+ * decompression history, so the entry is never decompressed as a whole
+ * @param ctx
+ * @param entryName
+ * @return entry reader, NULL if entry was not found or on error
+ */
+zpak_entry_t* zpak_entry_open(zpak_t *ctx, const char *entryName);
+
+/**
+ * Reads and decompresses next chunk of entry data into user buffer
+ * @param reader entry reader
+ * @param data user buffer
+ * @param size user buffer size
+ * @return number of bytes read, 0 at the end of entry, -1 on error
+ */
+int zpak_entry_read(zpak_entry_t *reader, void *data, int size);
+
+/**
+ * Closes entry reader
+ * @param reader entry reader
+ */
+void zpak_entry_close(zpak_entry_t *reader);
+
 // iterator
 
 /**
@@ -177,6 +560,14 @@ int zpak_read(zpak_t *ctx, const char *entryName, void **data);
  */
 zpak_it_t* zpak_it_construct(zpak_t *ctx);
 
+/**
+ * Initializes iterator in caller owned storage, which needs no destruction
+ * @param storage iterator storage
+ * @param ctx zpak instance
+ * @return iterator instance
+ */
+zpak_it_t* zpak_it_init(zpak_it_storage_t *storage, zpak_t *ctx);
+
 /**
  * Destructs iterator instance
  * @param it iterator instance
@@ -190,6 +581,18 @@ void zpak_it_destruct(zpak_it_t *it);
  */
 int zpak_it_next(zpak_it_t *it);
 
+/**
+ * Resets iterator to walk only the entries, which names start with the prefix. 
+ * With name index (see ZPAK_F_NAME_INDEX) the range is found by binary search 
+ * and entries are walked in the name order, without touching entry data, 
+ * otherwise entries are filtered in the blob order
+ * @param ctx
+ * @param prefix entry name prefix, empty string matches all entries
+ * @param it iterator instance
+ * @return number of matching entries, -1 on error
+ */
+int zpak_list_prefix(zpak_t *ctx, const char *prefix, zpak_it_t *it);
+
 /**
  * Gets entry's decompressed data size
  * @param it iterator instance
@@ -213,20 +616,107 @@ const char* zpak_it_get_entry_name(zpak_it_t *it);
 int zpak_it_read(zpak_it_t *it, void **data);
 
 /**
- * Reads entry data into user defined buffer
+ * Reads entry data into user defined buffer, data is truncated to the buffer size
  * @param it iterator instance
  * @param data output buffer
  * @param size output buffer size
- * @return decompressed data size
+ * @return decompressed data size of the whole entry, -1 on error
  */
 int zpak_it_read_buf(zpak_it_t *it, void *data, int size);
 
+/**
+ * Enables in-memory index for archives without directory (zpak v1). 
+ * The index is built on the first lookup, by walking the entries once,
+ * and is allocated through the context allocator
+ * @param ctx
+ * @param enable non-zero to enable, zero to disable and free the index
+ */
+void zpak_set_lazy_index(zpak_t *ctx, int enable);
+
+/**
+ * Verifies zpak blob, entry headers, names, compressed data and directories are 
+ * checked to be well-formed. Verified blob is decompressed without malformed data 
+ * checks, until the blob is modified
+ * @param ctx
+ * @return success code, -1 if blob is malformed
+ */
+int zpak_verify(zpak_t *ctx);
+
+/**
+ * Sets block size of chunked entries, written with ZPAK_F_CHUNKED, entries of 
+ * the block size or smaller are written as a single lzs stream, default is 64KB
+ * @param ctx
+ * @param size decompressed block size
+ * @return success code, -1 on error
+ */
+int zpak_set_chunk_size(zpak_t *ctx, int size);
+
+/**
+ * Sets number of worker threads, which compress and decompress blocks of chunked 
+ * entries (see ZPAK_F_CHUNKED) and compress zpak_write_batch entries. Output is 
+ * the same for any thread count. 
+ * Threads are used only when the library is built with ZPAK_THREADS, default is 1
+ * @param ctx
+ * @param threads thread count, 0 uses all available cores
+ * @return success code, -1 on error
+ */
+int zpak_set_threads(zpak_t *ctx, int threads);
+
+/**
+ * Sets lzs compression level of written entries, from 0 (fastest) to 9 (smallest).
+ * Level 0 probes a single hash slot per position, level 1 is the default greedy parse, 
+ * levels 3-4 use lazy matching, levels 5-9 use optimal parsing. Entries of any level 
+ * are read the same way
+ * @param ctx
+ * @param level compression level
+ * @return success code, -1 on error
+ */
+int zpak_set_level(zpak_t *ctx, int level);
+
+/**
+ * Sets bloom filter size, written with ZPAK_F_BLOOM. More bits per entry 
+ * lower false positive rate, default 10 bits give ~1%
+ * @param ctx
+ * @param bitsPerEntry bits per entry, 1..64
+ * @return success code, -1 on error
+ */
+int zpak_set_bloom_bits(zpak_t *ctx, int bitsPerEntry);
+
+/**
+ * Enables entry cache used by zpak_read_cached, which keeps decompressed entries 
+ * up to the byte budget with clock eviction. Entries with outstanding views are 
+ * not evicted, entries larger than the budget are not cached. The cache is 
+ * cleared on write
+ * @param ctx
+ * @param budget cache size in bytes, zero disables the cache
+ * @return success code, -1 on error
+ */
+int zpak_set_entry_cache(zpak_t *ctx, int budget);
+
+/**
+ * Enables lookup cache, which keeps resolved entry offsets and missing names 
+ * by name hash, so repeated lookups skip the directory probe or the scan.
+ * The cache is set associative with clock eviction and is cleared on write
+ * @param ctx
+ * @param slots number of cached lookups, rounded up to power of two, zero disables the cache
+ * @return success code, -1 on error
+ */
+int zpak_set_lookup_cache(zpak_t *ctx, int slots);
+
+/**
+ * Gets runtime statistics
+ * @param ctx
+ * @param stats output statistics
+ */
+void zpak_get_stats(zpak_t *ctx, zpak_stats_t *stats);
+
 // error
 
 /**
- * Gets last error string
+ * Gets last error string, errors are kept per thread, so the error is the one 
+ * of the last failed call on the context made by the calling thread
  * @param ctx
- * @return error string
+ * @return error string, NULL if there was no error
  */
 const char* zpak_get_last_error(zpak_t *ctx);
 